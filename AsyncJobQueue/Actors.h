@@ -0,0 +1,266 @@
+#pragma once
+
+#include "AsyncJobQueue.h"
+#include "ScopeExit.h"
+
+// Actor mode for a keyed queue: every key has a mailbox and a lazily constructed State. Messages sent
+// to a key are processed one at a time in the order they were sent, so a message has exclusive access
+// to its actor's state without any locking. An actor with an empty mailbox is idle; once the estimated
+// footprint of all actors exceeds the memory limit, the least recently used idle actors are evicted and
+// recreated from the factory on their next message. job_queue.Join(key) waits for a key's mailbox to
+// drain; job_queue.Cancel must not be used for keys of actors. Any keyed queue with a matching Key can
+// host the actors, whatever its key and queue policies. A message that throws is dropped and the
+// exception propagates like that of any other job; the actor goes on with the rest of its mailbox.
+template <typename Key, typename State>
+class Actors final
+{
+public:
+	using Factory = std::function<State(Key const&)>;
+
+	template <typename KeyPolicy, typename QueuePolicy>
+	explicit Actors(AsyncJobQueue<Key, KeyPolicy, QueuePolicy>& job_queue, Factory factory = DefaultFactory)
+		: add_drain_job{ [this, &job_queue](Key const& key) { job_queue.Add(key, &Actors::Drain, this, key); } }
+		, factory{ std::move(factory) }
+	{
+	}
+
+	Actors(Actors const&) = delete;
+	Actors& operator=(Actors const&) = delete;
+
+	template <typename Func, typename... Ts>
+	requires std::is_same_v<std::invoke_result_t<Func, State&, Ts...>, void>
+	void Tell(Key const& key, Func&& func, Ts&&... ts)
+	{
+		auto invoke{ [func = std::forward<Func>(func), ...ts = std::forward<Ts>(ts)](State& state) mutable {
+			std::invoke(std::move(func), state, std::move(ts)...);
+		} };
+		std::unique_ptr<Message> message{ std::make_unique<MessageOf<decltype(invoke)>>(std::move(invoke)) };
+
+		std::unique_lock lk{ mutex };
+
+		auto& actor{ actors[key] };
+
+		actor.mailbox.push_back(std::move(message));
+
+		if (std::exchange(actor.scheduled, true))
+		{
+			return;
+		}
+
+		if (actor.state)
+		{
+			idle_actors.erase(actor.idle_it);
+		}
+
+		lk.unlock();
+
+		add_drain_job(key);
+	}
+
+	// footprint estimates the memory used by one actor's state; by default it is sizeof(State).
+	void SetMemoryLimit(std::size_t memory_limit, std::function<std::size_t(State const&)> footprint = nullptr)
+	{
+		std::unique_lock lk{ mutex };
+
+		this->memory_limit = memory_limit;
+		this->footprint = std::move(footprint);
+
+		auto evicted_actors{ Evict() };
+
+		lk.unlock();
+
+		NotifyEvicted(evicted_actors);
+	}
+
+	// Receives the state of every evicted actor, e.g. to persist it.
+	void SetEvictionHandler(std::function<void(Key const&, State&&)> handler)
+	{
+		std::lock_guard lk{ mutex };
+
+		eviction_handler = std::move(handler);
+	}
+
+	std::size_t GetNumberOfActors()
+	{
+		std::lock_guard lk{ mutex };
+
+		return std::size(actors);
+	}
+
+	std::size_t GetMemoryUsage()
+	{
+		std::lock_guard lk{ mutex };
+
+		return memory_usage;
+	}
+
+private:
+	// Move-only, so that messages can carry move-only arguments without std::function's copyability
+	struct Message
+	{
+		virtual ~Message() = default;
+		virtual void operator()(State& state) = 0;
+	};
+
+	template <typename Func>
+	struct MessageOf final : Message
+	{
+		Func func;
+
+		explicit MessageOf(Func&& func)
+			: func{ std::move(func) }
+		{
+		}
+
+		void operator()(State& state) override
+		{
+			std::invoke(func, state);
+		}
+	};
+
+	struct Actor
+	{
+		std::optional<State> state;
+		std::deque<std::unique_ptr<Message>> mailbox;
+		bool scheduled{};
+		std::size_t footprint{};
+		// Position in idle_actors while the actor has a state and is not scheduled
+		typename std::list<Key>::iterator idle_it;
+	};
+
+	// Bounds how long one busy actor keeps a worker before it requeues behind other jobs.
+	static constexpr std::size_t max_messages_per_turn{ 64 };
+
+	// Adds a Drain job for a key to the queue the actors were constructed with.
+	std::function<void(Key const&)> const add_drain_job;
+	Factory const factory;
+	std::mutex mutex;
+	std::map<Key, Actor> actors;
+	std::list<Key> idle_actors;	// Most recently used first
+	std::size_t memory_usage{};
+	std::size_t memory_limit{ std::numeric_limits<std::size_t>::max() };
+	std::function<std::size_t(State const&)> footprint;
+	std::function<void(Key const&, State&&)> eviction_handler;
+
+	static State DefaultFactory(Key const& key)
+	{
+		if constexpr (std::is_constructible_v<State, Key const&>)
+		{
+			return State{ key };
+		}
+		else
+		{
+			return State{};
+		}
+	}
+
+	// Only the scheduled drain job touches the actor's state, and idle actors are the only ones evicted,
+	// so the state is used without holding the mutex.
+	void Drain(Key const& key)
+	{
+		std::unique_lock lk{ mutex };
+
+		auto& actor{ actors.find(key)->second };
+
+		// Also when a message or the factory throws, so that the actor is not left scheduled for good.
+		ScopeExit const finish{ [this, &lk, &actor, &key] {
+			if (!lk.owns_lock())
+			{
+				lk.lock();
+			}
+
+			FinishTurn(lk, actor, key);
+		} };
+
+		for (std::size_t i{}; i < max_messages_per_turn && !std::empty(actor.mailbox); ++i)
+		{
+			auto message{ std::move(actor.mailbox.front()) };
+
+			actor.mailbox.pop_front();
+
+			lk.unlock();
+
+			if (!actor.state)
+			{
+				actor.state.emplace(factory(key));
+			}
+
+			(*message)(*actor.state);
+
+			lk.lock();
+		}
+	}
+
+	// Requeues the actor if its mailbox is not empty, and otherwise makes it idle.
+	void FinishTurn(std::unique_lock<std::mutex>& lk, Actor& actor, Key const& key)
+	{
+		if (!std::empty(actor.mailbox))
+		{
+			lk.unlock();
+
+			add_drain_job(key);
+
+			return;
+		}
+
+		// The factory threw for the actor's first message, and there is nothing left to build it for.
+		if (!actor.state)
+		{
+			actors.erase(key);
+
+			return;
+		}
+
+		actor.scheduled = false;
+		memory_usage -= actor.footprint;
+		actor.footprint = footprint ? footprint(*actor.state) : sizeof(State);
+		memory_usage += actor.footprint;
+		actor.idle_it = idle_actors.insert(std::begin(idle_actors), key);
+
+		auto evicted_actors{ Evict() };
+
+		lk.unlock();
+
+		NotifyEvicted(evicted_actors);
+	}
+
+	std::vector<std::pair<Key, State>> Evict()
+	{
+		std::vector<std::pair<Key, State>> evicted_actors;
+
+		while (memory_usage > memory_limit && !std::empty(idle_actors))
+		{
+			auto const it{ actors.find(idle_actors.back()) };
+
+			idle_actors.pop_back();
+			memory_usage -= it->second.footprint;
+			evicted_actors.emplace_back(it->first, std::move(*it->second.state));
+			actors.erase(it);
+		}
+
+		return evicted_actors;
+	}
+
+	// Runs the handler, and the destructors of the evicted states, outside the lock.
+	void NotifyEvicted(std::vector<std::pair<Key, State>>& evicted_actors)
+	{
+		if (std::empty(evicted_actors))
+		{
+			return;
+		}
+
+		std::unique_lock lk{ mutex };
+
+		auto handler{ eviction_handler };
+
+		lk.unlock();
+
+		if (handler)
+		{
+			for (auto& [key, state] : evicted_actors)
+			{
+				handler(key, std::move(state));
+			}
+		}
+	}
+};
@@ -1,11 +1,17 @@
 #include "AsyncJobQueue.h"
 
+#include <cmath>
+
+thread_local AsyncJobQueue<NoKey>::RunningJobFrame const* AsyncJobQueue<NoKey>::running_job_frame{};
+thread_local AsyncJobQueue<NoKey> const* AsyncJobQueue<NoKey>::worker_queue{};
+thread_local std::size_t AsyncJobQueue<NoKey>::worker_index{};
+
 AsyncJobQueue<NoKey>::AsyncJobQueue(std::size_t number_of_threads)
-	: thread_pool{ number_of_threads }
-	, number_of_busy_threads{ std::size(thread_pool) }
+	: spawned_job_deques{ number_of_threads + 1 }
+	, thread_pool{ number_of_threads }
 {
-	std::ranges::generate(thread_pool, [this] {
-		return std::jthread{ std::bind_front(&AsyncJobQueue::JobDispatcherThread, this) };
+	std::ranges::generate(thread_pool, [this, index = std::size_t{}]() mutable {
+		return std::jthread{ std::bind_front(&AsyncJobQueue::JobDispatcherThread, this, index++) };
 	});
 }
 
@@ -17,58 +23,479 @@ AsyncJobQueue<NoKey>::~AsyncJobQueue()
 	}
 
 	job_condition_variable.notify_all();
+
+	std::unique_lock lk{ mutex_for_condition_variable };
+
+	auto stop_source{ this->stop_source };
+
+	lk.unlock();
+
+	stop_source.request_stop();
 }
 
 void AsyncJobQueue<NoKey>::Join()
 {
-	job_condition_variable.notify_all();
-
 	std::unique_lock lk{ mutex_for_condition_variable };
 
-	join_condition_variable.wait(lk, [this] { return number_of_busy_threads == 0; });
+	++number_of_joining_threads;
+
+	ScopeExit const leave{ [this] {
+		--number_of_joining_threads;
+	} };
+
+	while (!std::empty(job_queue) || number_of_spawned_jobs != 0 || number_of_running_jobs != CountRunningJobFrames())
+	{
+		if (!std::empty(job_queue))
+		{
+			RunJob(lk);
+		}
+		else if (number_of_spawned_jobs == 0 || !RunSpawnedJob(lk, GetWorkerIndex(), nullptr))
+		{
+			join_condition_variable.wait(lk);
+		}
+	}
 }
 
 void AsyncJobQueue<NoKey>::Cancel()
 {
 	decltype(job_queue) temp;
 
-	std::lock_guard lk{ mutex_for_condition_variable };
+	std::unique_lock lk{ mutex_for_condition_variable };
 
 	temp.swap(job_queue);
+
+	auto stop_source{ std::exchange(this->stop_source, {}) };
+
+	lk.unlock();
+
+	stop_source.request_stop();
+
+	join_condition_variable.notify_all();
+	add_condition_variable.notify_all();
 }
 
-void AsyncJobQueue<NoKey>::JobDispatcherThread(std::stop_token stop_token)
+void AsyncJobQueue<NoKey>::SetCallerRunsPolicy(CallerRunsPolicy const& policy)
 {
-	while (true)
-	{	
-		if (std::unique_lock lk{ mutex_for_condition_variable }; 
-			std::empty(job_queue))
+	std::lock_guard lk{ mutex_for_condition_variable };
+
+	caller_runs_policy = policy;
+}
+
+void AsyncJobQueue<NoKey>::SetCapacity(std::size_t capacity)
+{
+	std::unique_lock lk{ mutex_for_condition_variable };
+
+	this->capacity = std::max<std::size_t>(capacity, 1);
+
+	lk.unlock();
+
+	add_condition_variable.notify_all();
+}
+
+void AsyncJobQueue<NoKey>::SetCoDelPolicy(std::optional<CoDelPolicy<>> const& policy)
+{
+	std::lock_guard lk{ mutex_for_condition_variable };
+
+	if (policy)
+	{
+		codel_controller.emplace(policy->target, policy->interval);
+		shed_filter = policy->shed_filter;
+	}
+	else
+	{
+		codel_controller.reset();
+		shed_filter = nullptr;
+	}
+}
+
+void AsyncJobQueue<NoKey>::SetExpiredJobHandler(std::function<void()> handler)
+{
+	std::lock_guard lk{ mutex_for_condition_variable };
+
+	expired_job_handler = std::move(handler);
+}
+
+JobQueueMetrics AsyncJobQueue<NoKey>::GetMetrics()
+{
+	std::lock_guard lk{ mutex_for_condition_variable };
+
+	return metrics;
+}
+
+std::size_t AsyncJobQueue<NoKey>::GetNumberOfThreads() const
+{
+	return std::size(thread_pool);
+}
+
+std::size_t AsyncJobQueue<NoKey>::GetWorkerIndex() const
+{
+	return worker_queue == this ? worker_index : std::size(thread_pool);
+}
+
+std::stop_token AsyncJobQueue<NoKey>::GetStopToken()
+{
+	std::lock_guard lk{ mutex_for_condition_variable };
+
+	return stop_source.get_token();
+}
+
+bool AsyncJobQueue<NoKey>::WaitForCapacity(std::unique_lock<std::mutex>& lk, std::chrono::steady_clock::time_point deadline)
+{
+	while (std::size(job_queue) >= capacity)
+	{
+		if (CountRunningJobFrames() != 0)
 		{
-			--number_of_busy_threads;
+			RunJob(lk);
 
-			if (number_of_busy_threads == 0)
-			{
-				join_condition_variable.notify_all();
-			}
+			continue;
+		}
+
+		if (deadline == std::chrono::steady_clock::time_point::min())
+		{
+			return false;
+		}
+
+		++number_of_waiting_producers;
+
+		if (deadline == std::chrono::steady_clock::time_point::max())
+		{
+			add_condition_variable.wait(lk);
+		}
+		else if (add_condition_variable.wait_until(lk, deadline) == std::cv_status::timeout)
+		{
+			deadline = std::chrono::steady_clock::time_point::min();
+		}
+
+		--number_of_waiting_producers;
+	}
+
+	return true;
+}
+
+bool AsyncJobQueue<NoKey>::Submit(std::future<void>&& job, std::chrono::steady_clock::time_point deadline, std::chrono::steady_clock::time_point expiry)
+{
+	std::unique_lock lk{ mutex_for_condition_variable };
+
+	if (std::size(job_queue) >= caller_runs_policy.max_pending_jobs
+		|| number_of_idle_threads < caller_runs_policy.min_idle_threads)
+	{
+		++metrics.number_of_inline_jobs;
+
+		Execute(lk, job);
+
+		return true;
+	}
+
+	if (deadline != std::chrono::steady_clock::time_point::max()
+		&& codel_controller && codel_controller->Dropping()
+		&& (!shed_filter || shed_filter({})))
+	{
+		++metrics.number_of_rejected_jobs;
+
+		return false;
+	}
+
+	if (!WaitForCapacity(lk, deadline))
+	{
+		++metrics.number_of_rejected_jobs;
+
+		return false;
+	}
+
+	job_queue.push({ std::move(job), std::chrono::steady_clock::now(), expiry });
 
-			job_condition_variable.wait(lk, [this, &stop_token] { return stop_token.stop_requested() || !std::empty(job_queue); });			
+	auto const notify_joining_threads{ number_of_joining_threads != 0 };
 
-			if (stop_token.stop_requested() && std::empty(job_queue))
+	lk.unlock();
+
+	job_condition_variable.notify_one();
+
+	if (notify_joining_threads)
+	{
+		join_condition_variable.notify_all();
+	}
+
+	return true;
+}
+
+std::size_t AsyncJobQueue<NoKey>::CountRunningJobFrames() const
+{
+	std::size_t count{};
+
+	for (auto frame{ running_job_frame }; frame != nullptr; frame = frame->parent)
+	{
+		if (frame->queue == this)
+		{
+			++count;
+		}
+	}
+
+	return count;
+}
+
+// Only the oldest job can be shed, as job_queue does not support removal from the middle.
+bool AsyncJobQueue<NoKey>::ShedJob()
+{
+	auto const now{ std::chrono::steady_clock::now() };
+	auto const sojourn{ now - job_queue.front().enqueue_time };
+
+	if (!codel_controller->ShouldDrop(sojourn, now, std::size(job_queue) == 1)
+		|| (shed_filter && !shed_filter(sojourn)))
+	{
+		return false;
+	}
+
+	codel_controller->Drop(now);
+
+	return true;
+}
+
+void AsyncJobQueue<NoKey>::RunJob(std::unique_lock<std::mutex>& lk)
+{
+	auto const expired{ job_queue.front().expiry != std::chrono::steady_clock::time_point::max()
+		&& job_queue.front().expiry <= std::chrono::steady_clock::now() };
+	auto const shed{ !expired && codel_controller && ShedJob() };
+	auto job{ std::move(job_queue.front().job) };
+
+	job_queue.pop();
+
+	if (number_of_waiting_producers != 0)
+	{
+		add_condition_variable.notify_one();
+	}
+
+	if (!expired && !shed)
+	{
+		Execute(lk, job);
+
+		return;
+	}
+
+	++(expired ? metrics.number_of_expired_jobs : metrics.number_of_shed_jobs);
+
+	if (number_of_joining_threads != 0)
+	{
+		join_condition_variable.notify_all();
+	}
+
+	auto handler{ expired ? expired_job_handler : nullptr };
+
+	lk.unlock();
+
+	// Destroy the discarded job, and whatever it captured, outside the lock.
+	job = {};
+
+	if (handler)
+	{
+		handler();
+	}
+
+	lk.lock();
+}
+
+void AsyncJobQueue<NoKey>::Execute(std::unique_lock<std::mutex>& lk, std::future<void>& job)
+{
+	++number_of_running_jobs;
+
+	RunningJobFrame const frame{ this, running_job_frame };
+
+	running_job_frame = &frame;
+
+	lk.unlock();
+
+	// If the job throws, the exception propagates to the caller with lk held again.
+	ScopeExit const finish{ [this, &lk, &frame] {
+		lk.lock();
+
+		running_job_frame = frame.parent;
+
+		--number_of_running_jobs;
+
+		if (number_of_joining_threads != 0)
+		{
+			join_condition_variable.notify_all();
+		}
+	} };
+
+	job.get();
+}
+
+void AsyncJobQueue<NoKey>::Spawn(std::future<void>&& job, void const* group)
+{
+	std::unique_lock lk{ mutex_for_condition_variable };
+
+	spawned_job_deques[GetWorkerIndex()].push_back({ std::move(job), group });
+
+	++number_of_spawned_jobs;
+
+	auto const notify_idle_threads{ number_of_idle_threads != 0 };
+	auto const notify_joining_threads{ number_of_joining_threads != 0 };
+
+	lk.unlock();
+
+	if (notify_idle_threads)
+	{
+		job_condition_variable.notify_one();
+	}
+
+	if (notify_joining_threads)
+	{
+		join_condition_variable.notify_all();
+	}
+}
+
+void AsyncJobQueue<NoKey>::Sync(void const* group, std::atomic_size_t const& number_of_pending_jobs)
+{
+	if (number_of_pending_jobs == 0)
+	{
+		return;
+	}
+
+	auto const index{ GetWorkerIndex() };
+
+	std::unique_lock lk{ mutex_for_condition_variable };
+
+	++number_of_joining_threads;
+
+	ScopeExit const leave{ [this] {
+		--number_of_joining_threads;
+	} };
+
+	while (number_of_pending_jobs != 0)
+	{
+		if (!RunSpawnedJob(lk, index, group))
+		{
+			join_condition_variable.wait(lk);
+		}
+	}
+}
+
+// Runs the newest job of deque index, or steals the oldest job of another deque. When called from Sync,
+// only jobs of the syncing group are taken from the own deque, as older jobs there belong to the callers.
+bool AsyncJobQueue<NoKey>::RunSpawnedJob(std::unique_lock<std::mutex>& lk, std::size_t index, void const* group)
+{
+	auto& own_deque{ spawned_job_deques[index] };
+	std::future<void> job;
+
+	if (!std::empty(own_deque) && (group == nullptr || own_deque.back().group == group))
+	{
+		job = std::move(own_deque.back().job);
+		own_deque.pop_back();
+	}
+	else if (number_of_spawned_jobs != 0 && (group == nullptr || CountRunningJobFrames() < max_stealing_depth))
+	{
+		for (std::size_t offset{ 1 }; offset < std::size(spawned_job_deques); ++offset)
+		{
+			if (auto& victim_deque{ spawned_job_deques[(index + offset) % std::size(spawned_job_deques)] };
+				!std::empty(victim_deque))
 			{
+				job = std::move(victim_deque.front().job);
+				victim_deque.pop_front();
+
 				break;
 			}
+		}
+	}
+
+	if (!job.valid())
+	{
+		return false;
+	}
+
+	--number_of_spawned_jobs;
 
-			++number_of_busy_threads;
+	Execute(lk, job);
+
+	return true;
+}
+
+void AsyncJobQueue<NoKey>::JobDispatcherThread(std::size_t index, std::stop_token stop_token)
+{
+	worker_queue = this;
+	worker_index = index;
+
+	while (true)
+	{	
+		if (std::unique_lock lk{ mutex_for_condition_variable }; 
+			!std::empty(spawned_job_deques[index]))
+		{
+			RunSpawnedJob(lk, index, nullptr);
+		}
+		else if (!std::empty(job_queue))
+		{
+			RunJob(lk);
+		}
+		else if (number_of_spawned_jobs != 0)
+		{
+			RunSpawnedJob(lk, index, nullptr);
 		}
 		else
 		{
-			auto job{ std::move(job_queue.front()) };
+			++number_of_idle_threads;
+			job_condition_variable.wait(lk, [this, &stop_token] { return stop_token.stop_requested() || !std::empty(job_queue) || number_of_spawned_jobs != 0; });
+			--number_of_idle_threads;
+
+			if (stop_token.stop_requested() && std::empty(job_queue) && number_of_spawned_jobs == 0)
+			{
+				break;
+			}
+		}
+	}
+}
 
-			job_queue.pop();
+CoDelController::CoDelController(std::chrono::steady_clock::duration target, std::chrono::steady_clock::duration interval)
+	: target{ target }
+	, interval{ interval }
+{
+}
 
-			lk.unlock();
+bool CoDelController::ShouldDrop(std::chrono::steady_clock::duration sojourn, std::chrono::steady_clock::time_point now, bool queue_empty)
+{
+	auto ok_to_drop{ false };
 
-			job.get();
-		}
+	if (sojourn < target || queue_empty)
+	{
+		first_above_time = {};
+	}
+	else if (first_above_time == std::chrono::steady_clock::time_point{})
+	{
+		first_above_time = now + interval;
 	}
+	else if (now >= first_above_time)
+	{
+		ok_to_drop = true;
+	}
+
+	if (dropping && !ok_to_drop)
+	{
+		dropping = false;
+	}
+
+	return ok_to_drop && (!dropping || now >= drop_next);
+}
+
+void CoDelController::Drop(std::chrono::steady_clock::time_point now)
+{
+	if (dropping)
+	{
+		++drop_count;
+		drop_next = ControlLaw(drop_next);
+
+		return;
+	}
+
+	// Resume near the previous drop rate if the last dropping state ended recently.
+	drop_count = drop_count > 2 && now - drop_next < interval * 16 ? drop_count - 2 : 1;
+	drop_next = ControlLaw(now);
+	dropping = true;
+}
+
+bool CoDelController::Dropping() const
+{
+	return dropping;
+}
+
+std::chrono::steady_clock::time_point CoDelController::ControlLaw(std::chrono::steady_clock::time_point t) const
+{
+	return t + std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval / std::sqrt(static_cast<double>(drop_count)));
 }
@@ -1,204 +1,1714 @@
 #pragma once
 
+#include "FlatHashMap.h"
+#include "KeyTable.h"
+#include "SpinLock.h"
+#include "ScopeExit.h"
+
+#include <algorithm>
 #include <thread>
+#include <stop_token>
 #include <mutex>
 #include <functional>
 #include <string>
 #include <condition_variable>
 #include <queue>
+#include <deque>
 #include <future>
 #include <map>
+#include <set>
 #include <vector>
 #include <list>
+#include <memory>
+#include <memory_resource>
+#include <ranges>
+#include <span>
+#include <limits>
+#include <chrono>
+#include <optional>
+#include <utility>
+#include <atomic>
+#include <variant>
+
+struct NoKey
+{
+	// Nothing
+};
+
+inline constexpr std::size_t cache_line_size{ 64 };
+
+// Add/AddWithCallback execute the job on the producer's thread instead of queueing it
+// when the queue is deeper than max_pending_jobs or fewer than min_idle_threads workers are idle.
+struct CallerRunsPolicy
+{
+	std::size_t max_pending_jobs{ std::numeric_limits<std::size_t>::max() };
+	std::size_t min_idle_threads{};
+};
+
+// Controlled-delay load shedding: once every dequeued job has waited longer than target for a whole
+// interval, jobs are shed at an increasing rate and TryAdd/TryAddFor reject new ones.
+template <typename Key = NoKey>
+struct CoDelPolicy
+{
+	using ShedFilter = std::conditional_t<std::is_same_v<Key, NoKey>,
+		std::function<bool(std::chrono::steady_clock::duration)>,
+		std::function<bool(Key const&, std::chrono::steady_clock::duration)>>;
+
+	std::chrono::steady_clock::duration target{ std::chrono::milliseconds{ 5 } };
+	std::chrono::steady_clock::duration interval{ std::chrono::milliseconds{ 100 } };
+	// Offered pending jobs oldest first with their sojourn time (zero for new submissions);
+	// returns whether the job may be dropped. Empty drops the oldest job.
+	ShedFilter shed_filter;
+};
+
+class CoDelController
+{
+public:
+	CoDelController(std::chrono::steady_clock::duration target, std::chrono::steady_clock::duration interval);
+
+	// Whether the control law calls for a drop now. The drop only counts towards the drop rate once
+	// Drop is called, so a drop that finds no job to shed does not speed up later ones.
+	bool ShouldDrop(std::chrono::steady_clock::duration sojourn, std::chrono::steady_clock::time_point now, bool queue_empty);
+	void Drop(std::chrono::steady_clock::time_point now);
+	bool Dropping() const;
+
+private:
+	std::chrono::steady_clock::duration target;
+	std::chrono::steady_clock::duration interval;
+	std::chrono::steady_clock::time_point first_above_time{};
+	std::chrono::steady_clock::time_point drop_next{};
+	std::size_t drop_count{};
+	bool dropping{};
+
+	std::chrono::steady_clock::time_point ControlLaw(std::chrono::steady_clock::time_point t) const;
+};
+
+// Kernels of AddBulk take either a whole chunk of arguments as a span or a single argument;
+// in the latter case the loop over the chunk is instantiated per kernel type and can be inlined.
+template <typename Kernel, typename Arg>
+concept BulkKernel = std::invocable<Kernel const&, std::span<Arg const>> || std::invocable<Kernel const&, Arg const&>;
+
+template <typename Kernel, typename Arg>
+void InvokeBulkKernel(Kernel const& kernel, std::span<Arg const> chunk)
+{
+	if constexpr (std::invocable<Kernel const&, std::span<Arg const>>)
+	{
+		std::invoke(kernel, chunk);
+	}
+	else
+	{
+		for (auto const& arg : chunk)
+		{
+			std::invoke(kernel, arg);
+		}
+	}
+}
+
+// A job may take a std::stop_token as its first parameter; the queue then passes a token that fires
+// when Cancel covers the job's key or the queue is destroyed, so a running job can stop early.
+template <typename Func, typename... Ts>
+using JobResult = typename std::conditional_t<std::invocable<Func, std::stop_token, Ts...>,
+	std::invoke_result<Func, std::stop_token, Ts...>, std::invoke_result<Func, Ts...>>::type;
+
+template <typename Func, typename... Ts>
+concept VoidJob = std::is_same_v<JobResult<Func, Ts...>, void>;
+
+// Specialize with a static Parent(key) returning the key's parent node, or std::nullopt at the top,
+// to enable JoinPrefix and CancelPrefix on AsyncJobQueue<Key>. The queue then keeps counts for every
+// node above the key of each job, so only key types meant as hierarchies should opt in.
+template <typename Key>
+struct KeyHierarchy;
+
+template <typename Key>
+concept HierarchicalKey = requires(Key const& key)
+{
+	{ KeyHierarchy<Key>::Parent(key) } -> std::same_as<std::optional<Key>>;
+};
+
+// String key whose '/'-separated prefixes form a hierarchy: "tenant/session/request" lies under
+// "tenant/session", which lies under "tenant". Plain std::string keys, such as paths or URLs, are not
+// treated as hierarchical.
+struct HierarchicalString
+{
+	std::string value;
+
+	HierarchicalString() = default;
+
+	HierarchicalString(std::string value)
+		: value{ std::move(value) }
+	{
+	}
+
+	HierarchicalString(char const* value)
+		: value{ value }
+	{
+	}
+
+	auto operator<=>(HierarchicalString const&) const = default;
+};
+
+template <>
+struct KeyHash<HierarchicalString>
+{
+	std::size_t operator()(HierarchicalString const& key) const noexcept
+	{
+		return std::hash<std::string>{}(key.value);
+	}
+};
+
+template <>
+struct KeyHierarchy<HierarchicalString>
+{
+	static std::optional<HierarchicalString> Parent(HierarchicalString const& key)
+	{
+		if (auto const separator{ key.value.rfind('/') }; separator != std::string::npos)
+		{
+			return key.value.substr(0, separator);
+		}
+
+		return std::nullopt;
+	}
+};
+
+// A type by which keys can be looked up without constructing a Key, e.g. std::string_view or const char*
+// for std::string keys; a Key is only built from it when the key is interned for the first time.
+template <typename K, typename Key>
+concept KeyLike = std::constructible_from<Key, K const&>;
+
+// Picks the containers in which AsyncJobQueue<Key> interns its keys (Table) and keeps other
+// per-key bookkeeping (Map). Both compare keys transparently.
+struct OrderedKeyPolicy
+{
+	template <typename Key, typename Value>
+	using Map = std::map<Key, Value, std::less<>>;
+
+	template <typename Key, typename Value>
+	using Table = KeyTable<Key, Value, OrderedKeyPolicy>;
+};
+
+// No per-key node allocations and constant-time lookups, transparent for std::string keys;
+// needs KeyHash<Key> (std::hash<Key> unless specialized) and equality comparison of keys.
+struct HashedKeyPolicy
+{
+	template <typename Key, typename Value>
+	using Map = FlatHashMap<Key, Value>;
+
+	template <typename Key, typename Value>
+	using Table = KeyTable<Key, Value, HashedKeyPolicy>;
+};
+
+// Specialize with a static constexpr std::size_t size for an enum or integral Key whose values all
+// lie in [0, size) to have AsyncJobQueue<Key> use DenseKeyPolicy by default. Jobs of keys outside
+// that range are rejected.
+template <typename Key>
+struct DenseKeyTraits
+{
+};
+
+template <typename Key>
+concept DenseKey = (std::is_enum_v<Key> || std::is_integral_v<Key>) && requires
+{
+	{ DenseKeyTraits<Key>::size } -> std::convertible_to<std::size_t>;
+};
+
+// The bookkeeping of every key is set up with the queue, and interning a key is an array index.
+struct DenseKeyPolicy
+{
+	template <typename Key, typename Value>
+	using Map = FlatHashMap<Key, Value>;
+
+	template <DenseKey Key, typename Value>
+	using Table = DenseKeyTable<Key, Value, DenseKeyTraits<Key>::size>;
+};
+
+template <typename Key>
+using DefaultKeyPolicy = std::conditional_t<DenseKey<Key>, DenseKeyPolicy, OrderedKeyPolicy>;
+
+// Picks how AsyncJobQueue<Key> locks, allocates and idles. Derive from DefaultQueuePolicy and
+// redeclare only the members to change.
+struct DefaultQueuePolicy
+{
+	// Guards the queue; std::mutex, HybridMutex, SpinLock or any other Lockable
+	using Mutex = std::mutex;
+	// A std::pmr resource owned by the queue, from which the nodes of its job lists and time indexes
+	// are allocated, only under its lock; void allocates them with std::allocator.
+	using MemoryResource = void;
+	// Times an idle worker yields and looks for jobs again before it blocks
+	static constexpr std::size_t idle_spin_count{};
+	// Default number of workers per hardware thread
+	static constexpr std::size_t threads_per_core{ 2 };
+};
+
+// Job nodes are recycled through a pool, and the short critical sections spin before they sleep.
+struct ThroughputQueuePolicy : DefaultQueuePolicy
+{
+	using Mutex = HybridMutex;
+	using MemoryResource = std::pmr::unsynchronized_pool_resource;
+};
+
+// As ThroughputQueuePolicy, and idle workers keep looking for jobs for a while, burning CPU time
+// to save the wake-up of a blocked thread when a job arrives.
+struct LatencyQueuePolicy : ThroughputQueuePolicy
+{
+	static constexpr std::size_t idle_spin_count{ 1000 };
+};
+
+// One worker, and so one stack, per hardware thread, and freed job nodes go back to the heap
+// rather than stay pooled.
+struct LowMemoryQueuePolicy : DefaultQueuePolicy
+{
+	static constexpr std::size_t threads_per_core{ 1 };
+};
+
+struct JobQueueMetrics
+{
+	std::size_t number_of_inline_jobs{};
+	std::size_t number_of_rejected_jobs{};
+	std::size_t number_of_shed_jobs{};
+	std::size_t number_of_expired_jobs{};
+	std::size_t number_of_coalesced_jobs{};
+};
+
+template <typename Key = NoKey, typename KeyPolicy = DefaultKeyPolicy<Key>, typename QueuePolicy = DefaultQueuePolicy>
+class AsyncJobQueue final
+{
+	// Only AsyncJobQueue<NoKey> itself is unkeyed; it does not take key or queue policies.
+	static_assert(!std::is_same_v<Key, NoKey>, "The unkeyed queue takes no policies: use AsyncJobQueue<> rather than AsyncJobQueue<NoKey, KeyPolicy, QueuePolicy>");
+
+	struct KeyState;
+
+	using KeyStateTable = typename KeyPolicy::template Table<Key, KeyState>;
+	// A std::shared_ptr, or a plain pointer for tables whose entries live as long as the table itself
+	using KeyStateHandle = typename KeyStateTable::Handle;
+
+public:
+	// A key interned in the queue. Adding a job by KeyId skips looking the key up; the queue keeps
+	// its bookkeeping for the key, and the one copy of the key, while a KeyId or job of the key exists.
+	// With DenseKeyPolicy the bookkeeping lives as long as the queue, which a KeyId then must not outlive.
+	class KeyId
+	{
+	public:
+		Key const& GetKey() const
+		{
+			return key_state->key;
+		}
+
+	private:
+		friend class AsyncJobQueue;
+
+		KeyStateHandle key_state;
+
+		explicit KeyId(KeyStateHandle key_state)
+			: key_state{ std::move(key_state) }
+		{
+		}
+	};
+
+	explicit AsyncJobQueue(std::size_t number_of_threads = std::thread::hardware_concurrency() * QueuePolicy::threads_per_core)
+		: thread_pool{ number_of_threads }
+	{
+		std::ranges::generate(thread_pool, [this] {
+			return std::jthread{ std::bind_front(&AsyncJobQueue::JobDispatcherThread, this) };
+		});
+	}
+
+	~AsyncJobQueue()
+	{
+		for (auto& t : thread_pool)
+		{
+			t.request_stop();
+		}
+
+		job_condition_variable.notify_all();
+
+		RequestStop();
+	}
+
+	template <KeyLike<Key> K, typename Func, typename... Ts>
+	requires VoidJob<Func, Ts...>
+	void Add(K const& key, Func&& func, Ts&&... ts)
+	{
+		Add(Intern(key), std::forward<Func>(func), std::forward<Ts>(ts)...);
+	}
+
+	// key_id must come from this queue.
+	template <typename Func, typename... Ts>
+	requires VoidJob<Func, Ts...>
+	void Add(KeyId const& key_id, Func&& func, Ts&&... ts)
+	{
+		// The key table rejected the key.
+		if (!key_id.key_state)
+		{
+			std::lock_guard lk{ mutex_for_condition_variable };
+
+			++metrics.number_of_rejected_jobs;
+
+			return;
+		}
+
+		auto job{ [this] <typename... Xs>(Xs&&... xs) {
+			std::invoke(std::forward<Xs>(xs)...);
+		} };
+
+		Submit(key_id.key_state, std::async(std::launch::deferred, job, BindStopToken<Ts...>(key_id.GetKey(), std::forward<Func>(func)), std::forward<Ts>(ts)...));
+	}
+
+	template <KeyLike<Key> K>
+	KeyId Intern(K const& key)
+	{
+		return KeyId{ key_table->Intern(ToLookupKey(key)) };
+	}
+
+	// Copies args into one contiguous buffer and queues a job per chunk_size arguments
+	// (0 picks a few chunks per worker), each running kernel over its chunk.
+	template <KeyLike<Key> K, typename Kernel, std::ranges::sized_range Range>
+	requires BulkKernel<std::decay_t<Kernel>, std::ranges::range_value_t<Range>>
+	void AddBulk(K const& key, Kernel&& kernel, Range const& args, std::size_t chunk_size = 0)
+	{
+		using Arg = std::ranges::range_value_t<Range>;
+
+		auto const shared_args{ std::make_shared<std::vector<Arg> const>(std::ranges::begin(args), std::ranges::end(args)) };
+		auto const shared_kernel{ std::make_shared<std::decay_t<Kernel> const>(std::forward<Kernel>(kernel)) };
+		auto const number_of_args{ std::size(*shared_args) };
+
+		if (chunk_size == 0)
+		{
+			chunk_size = std::max<std::size_t>(number_of_args / (std::max<std::size_t>(std::size(thread_pool), 1) * 4), 1);
+		}
+
+		auto const key_id{ Intern(key) };
+
+		for (std::size_t offset{}; offset < number_of_args; offset += chunk_size)
+		{
+			Add(key_id, [shared_args, shared_kernel, offset, count = std::min(chunk_size, number_of_args - offset)] {
+				InvokeBulkKernel(*shared_kernel, std::span<Arg const>{ *shared_args }.subspan(offset, count));
+			});
+		}
+	}
+
+	// The job is discarded without running if it is still pending at expiry; see SetExpiredJobHandler.
+	template <KeyLike<Key> K, typename Func, typename... Ts>
+	requires VoidJob<Func, Ts...>
+	void AddWithExpiry(K const& key, std::chrono::steady_clock::time_point expiry, Func&& func, Ts&&... ts)
+	{
+		auto job{ [this] <typename... Xs>(Xs&&... xs) {
+			std::invoke(std::forward<Xs>(xs)...);
+		} };
+
+		Submit(key_table->Intern(ToLookupKey(key)), std::async(std::launch::deferred, job, BindStopToken<Ts...>(key, std::forward<Func>(func)), std::forward<Ts>(ts)...), std::chrono::steady_clock::time_point::max(), expiry);
+	}
+
+	template <KeyLike<Key> K, typename Rep, typename Period, typename Func, typename... Ts>
+	requires VoidJob<Func, Ts...>
+	void AddWithTimeToLive(K const& key, std::chrono::duration<Rep, Period> const& time_to_live, Func&& func, Ts&&... ts)
+	{
+		AddWithExpiry(key, std::chrono::steady_clock::now() + time_to_live, std::forward<Func>(func), std::forward<Ts>(ts)...);
+	}
+
+	// The job becomes eligible to run once delay has elapsed; until then it counts as pending for Join.
+	template <KeyLike<Key> K, typename Rep, typename Period, typename Func, typename... Ts>
+	requires VoidJob<Func, Ts...>
+	void AddDelayed(K const& key, std::chrono::duration<Rep, Period> const& delay, Func&& func, Ts&&... ts)
+	{
+		auto job{ [this] <typename... Xs>(Xs&&... xs) {
+			std::invoke(std::forward<Xs>(xs)...);
+		} };
+
+		SubmitDelayed(key_table->Intern(ToLookupKey(key)), std::async(std::launch::deferred, job, BindStopToken<Ts...>(key, std::forward<Func>(func)), std::forward<Ts>(ts)...), std::chrono::steady_clock::now() + delay);
+	}
+
+	// Latest wins: replaces the job an earlier AddOrReplace queued for key if it has not started yet.
+	template <KeyLike<Key> K, typename Func, typename... Ts>
+	requires VoidJob<Func, Ts...>
+	void AddOrReplace(K const& key, Func&& func, Ts&&... ts)
+	{
+		auto job{ [this] <typename... Xs>(Xs&&... xs) {
+			std::invoke(std::forward<Xs>(xs)...);
+		} };
+
+		SubmitOrReplace(key_table->Intern(ToLookupKey(key)), std::async(std::launch::deferred, job, BindStopToken<Ts...>(key, std::forward<Func>(func)), std::forward<Ts>(ts)...));
+	}
+
+	// Returns false instead of blocking when the queue (or the key) is at capacity.
+	template <KeyLike<Key> K, typename Func, typename... Ts>
+	requires VoidJob<Func, Ts...>
+	bool TryAdd(K const& key, Func&& func, Ts&&... ts)
+	{
+		return TryAddUntil(key, std::chrono::steady_clock::time_point::min(), std::forward<Func>(func), std::forward<Ts>(ts)...);
+	}
+
+	template <KeyLike<Key> K, typename Rep, typename Period, typename Func, typename... Ts>
+	requires VoidJob<Func, Ts...>
+	bool TryAddFor(K const& key, std::chrono::duration<Rep, Period> const& timeout, Func&& func, Ts&&... ts)
+	{
+		return TryAddUntil(key, std::chrono::steady_clock::now() + timeout, std::forward<Func>(func), std::forward<Ts>(ts)...);
+	}
+
+	template <KeyLike<Key> K, typename Func, typename... Ts, std::invocable<JobResult<Func, Ts...>> Callback>
+	void AddWithCallback(K const& key, Callback&& callback, Func&& func, Ts&&... ts)
+	{
+		if constexpr (std::is_same_v<JobResult<Func, Ts...>, void>)
+		{
+			auto job{ [this] <typename... Xs>(Callback&& callback, Xs&&... xs) {
+				std::invoke(std::forward<Xs>(xs)...);
+				std::invoke(std::forward<Callback>(callback));
+			} };
+
+			Submit(key_table->Intern(ToLookupKey(key)), std::async(std::launch::deferred, job, std::forward<Callback>(callback), BindStopToken<Ts...>(key, std::forward<Func>(func)), std::forward<Ts>(ts)...));
+		}
+		else
+		{
+			auto job{ [this] <typename... Xs>(Callback&& callback, Xs&&... xs) {
+				std::invoke(std::forward<Callback>(callback), std::invoke(std::forward<Xs>(xs)...));
+			} };
+
+			Submit(key_table->Intern(ToLookupKey(key)), std::async(std::launch::deferred, job, std::forward<Callback>(callback), BindStopToken<Ts...>(key, std::forward<Func>(func)), std::forward<Ts>(ts)...));
+		}
+	}
+
+	void SetCallerRunsPolicy(CallerRunsPolicy const& policy)
+	{
+		std::lock_guard lk{ mutex_for_condition_variable };
+
+		caller_runs_policy = policy;
+	}
+
+	// Add blocks while the queue holds capacity pending jobs, or key_capacity pending jobs of the same key.
+	void SetCapacity(std::size_t capacity, std::size_t key_capacity = std::numeric_limits<std::size_t>::max())
+	{
+		std::unique_lock lk{ mutex_for_condition_variable };
+
+		this->capacity = std::max<std::size_t>(capacity, 1);
+		this->key_capacity = std::max<std::size_t>(key_capacity, 1);
+
+		lk.unlock();
+
+		add_condition_variable.notify_all();
+	}
+
+	// std::nullopt turns load shedding off.
+	void SetCoDelPolicy(std::optional<CoDelPolicy<Key>> const& policy)
+	{
+		std::lock_guard lk{ mutex_for_condition_variable };
+
+		if (policy)
+		{
+			codel_controller.emplace(policy->target, policy->interval);
+			shed_filter = policy->shed_filter;
+		}
+		else
+		{
+			codel_controller.reset();
+			shed_filter = nullptr;
+		}
+	}
+
+	// Jobs queued by AddOrReplace are held back until no replacement has arrived for interval.
+	void SetDebounceInterval(std::chrono::steady_clock::duration interval)
+	{
+		std::lock_guard lk{ mutex_for_condition_variable };
+
+		debounce_interval = interval;
+	}
+
+	// Called outside the lock, on a worker or producer thread, for each job discarded at its expiry.
+	void SetExpiredJobHandler(std::function<void(Key const&)> handler)
+	{
+		std::lock_guard lk{ mutex_for_condition_variable };
+
+		expired_job_handler = std::move(handler);
+	}
+
+	JobQueueMetrics GetMetrics()
+	{
+		std::lock_guard lk{ mutex_for_condition_variable };
+
+		return metrics;
+	}
+
+	std::size_t GetNumberOfThreads() const
+	{
+		return std::size(thread_pool);
+	}
+
+	// Runs pending jobs (of the given keys, if any) on the calling thread while waiting,
+	// so a Join issued from inside a job neither blocks a worker nor deadlocks the pool.
+	// A job does not wait for itself, but does wait for every other job, even one blocked in a Join
+	// of its own, so jobs whose Joins wait for each other deadlock; a job that waits for the jobs it
+	// added, while others do the same, joins their keys rather than the whole queue.
+	template <typename... Ts>
+	void Join(Ts const&... ts)
+	{
+		JoinUntil([this, &ts...] { return Ready(ts...); }, [this, &ts...] { return FindJob(ts...); });
+	}
+
+	// Joins prefix itself and every key under it. Checking for completion is one lookup, as the
+	// queue keeps a count of the pending and running jobs under each node that has any.
+	void JoinPrefix(Key const& prefix)
+		requires HierarchicalKey<Key>
+	{
+		JoinUntil([this, &prefix] { return PrefixReady(prefix); }, [this, &prefix] {
+			std::vector<Key> keys;
+
+			CollectSubtree(prefix, keys);
+
+			for (auto const& key : keys)
+			{
+				if (auto const it{ FindKeyJob(key) }; it != std::end(job_list))
+				{
+					return it;
+				}
+			}
+
+			return std::end(job_list);
+		});
+	}
+
+	// Jobs running on the calling thread itself (i.e. the caller is a job) are not waited for; every
+	// other job is, including one blocked in a Join of its own.
+	template <typename... Ts>
+	bool Ready(Ts const&... ts) const
+	{
+		if constexpr (sizeof...(Ts) == 0)
+		{
+			return GetNumberOfPendingJobs() == 0
+				&& number_of_in_progress_jobs == CountRunningJobFrames();
+		}
+		else
+		{
+			return ((GetPendingJobCount(ts) == 0) && ...)
+				&& ((GetInProgressJobCount(ts) == CountRunningJobFrames(ts)) && ...);
+		}
+	}
+
+	bool PrefixReady(Key const& prefix) const
+		requires HierarchicalKey<Key>
+	{
+		std::size_t number_of_running_job_frames{};
+
+		for (auto frame{ running_job_frame }; frame != nullptr; frame = frame->parent)
+		{
+			if (frame->queue == this && IsUnderPrefix(frame->key_state->key, prefix))
+			{
+				++number_of_running_job_frames;
+			}
+		}
+
+		auto const it{ prefix_map.find(prefix) };
+
+		return GetPendingJobCount(prefix) + GetInProgressJobCount(prefix) + (it != std::end(prefix_map) ? it->second.number_of_jobs : 0)
+			== number_of_running_job_frames;
+	}
+
+	// Also fires the stop tokens of the cancelled keys' jobs, pending and running. Takes time proportional
+	// to the number of keys, not jobs: the cancelled jobs no longer count as pending, so Join and the
+	// capacity limits see them gone at once, and workers free them as they reach them.
+	// Returns the number of pending jobs cancelled.
+	template <typename... Ts>
+		requires (KeyLike<Ts, Key> && ...)
+	std::size_t Cancel(Ts const&... ts)
+	{
+		RequestStop(ts...);
+
+		std::unique_lock lk{ mutex_for_condition_variable };
+
+		std::size_t number_of_cancelled_jobs{};
+
+		if constexpr (sizeof...(Ts) == 0)
+		{
+			for (auto const& key_state : key_table->GetValues())
+			{
+				number_of_cancelled_jobs += CancelKeyState(*key_state);
+			}
+		}
+		else
+		{
+			number_of_cancelled_jobs = (CancelKey(ts) + ...);
+		}
+
+		lk.unlock();
+
+		join_condition_variable.notify_all();
+		add_condition_variable.notify_all();
+
+		return number_of_cancelled_jobs;
+	}
+
+	// Cancels every key in the range, looking each up once.
+	template <std::ranges::input_range Range>
+		requires (!KeyLike<Range, Key> && KeyLike<std::ranges::range_value_t<Range>, Key>)
+	std::size_t Cancel(Range const& keys)
+	{
+		RequestStop(keys);
+
+		std::unique_lock lk{ mutex_for_condition_variable };
+
+		std::size_t number_of_cancelled_jobs{};
+
+		for (auto const& key : keys)
+		{
+			number_of_cancelled_jobs += CancelKey(key);
+		}
+
+		lk.unlock();
+
+		join_condition_variable.notify_all();
+		add_condition_variable.notify_all();
+
+		return number_of_cancelled_jobs;
+	}
+
+	// Cancels prefix itself and every key under it with pending or running jobs, visiting only
+	// the nodes below prefix.
+	std::size_t CancelPrefix(Key const& prefix)
+		requires HierarchicalKey<Key>
+	{
+		std::unique_lock lk{ mutex_for_condition_variable };
+
+		std::vector<Key> keys;
+
+		CollectSubtree(prefix, keys);
+
+		std::size_t number_of_cancelled_jobs{};
+
+		for (auto const& key : keys)
+		{
+			number_of_cancelled_jobs += CancelKey(key);
+		}
+
+		lk.unlock();
+
+		join_condition_variable.notify_all();
+		add_condition_variable.notify_all();
+
+		RequestStop(keys);
+
+		return number_of_cancelled_jobs;
+	}
+
+	// Cancels the keys with pending or running jobs that satisfy pred. pred is called under the queue's
+	// locks, so it must not call back into the queue.
+	template <std::predicate<Key const&> Pred>
+	std::size_t CancelIf(Pred pred)
+	{
+		RequestStopWith([this, &pred](auto const& take) {
+			for (auto it{ std::begin(stop_source_map) }; it != std::end(stop_source_map);)
+			{
+				it = std::invoke(pred, std::as_const(it->first)) ? take(it) : std::next(it);
+			}
+		});
+
+		std::unique_lock lk{ mutex_for_condition_variable };
+
+		std::size_t number_of_cancelled_jobs{};
+
+		for (auto const& key_state : key_table->GetValues())
+		{
+			if (key_state->number_of_pending_jobs != 0 && std::invoke(pred, std::as_const(key_state->key)))
+			{
+				number_of_cancelled_jobs += CancelKeyState(*key_state);
+			}
+		}
+
+		lk.unlock();
+
+		join_condition_variable.notify_all();
+		add_condition_variable.notify_all();
+
+		return number_of_cancelled_jobs;
+	}
+
+private:
+	struct RunningJobFrame
+	{
+		AsyncJobQueue const* queue;
+		KeyState* key_state;
+		RunningJobFrame const* parent;
+	};
+
+	template <typename Value>
+	using KeyMap = typename KeyPolicy::template Map<Key, Value>;
+
+	using Mutex = typename QueuePolicy::Mutex;
+	using ConditionVariable = std::conditional_t<std::is_same_v<Mutex, std::mutex>, std::condition_variable, std::condition_variable_any>;
+
+	template <typename T>
+	using Allocator = std::conditional_t<std::is_void_v<typename QueuePolicy::MemoryResource>, std::allocator<T>, std::pmr::polymorphic_allocator<T>>;
+
+	struct PendingJob;
+
+	using JobList = std::list<PendingJob, Allocator<PendingJob>>;
+	using TimeIndex = std::multimap<std::chrono::steady_clock::time_point, typename JobList::iterator,
+		std::less<>, Allocator<std::pair<std::chrono::steady_clock::time_point const, typename JobList::iterator>>>;
+
+	struct KeyState
+	{
+		Key key;
+		// Jobs of the current generation in job_list or deferred_job_list
+		std::size_t number_of_pending_jobs{};
+		std::size_t number_of_in_progress_jobs{};
+		// Cancelling the key starts a new generation; pending jobs of older ones are stale.
+		std::size_t generation{};
+		std::optional<typename JobList::iterator> coalescing_job{};
+		// Ends of the chain of the key's jobs in job_list and deferred_job_list, oldest first
+		std::optional<typename JobList::iterator> first_job{};
+		std::optional<typename JobList::iterator> last_job{};
+	};
+
+	struct PendingJob
+	{
+		KeyStateHandle key_state;
+		std::size_t generation;
+		std::future<void> job;
+		std::chrono::steady_clock::time_point enqueue_time;
+		typename TimeIndex::iterator expiry_it;
+		typename TimeIndex::iterator deferred_it;
+		bool coalescing;
+		// Neighbours in the chain of the key's jobs, which lets a keyed Join find a job of its key
+		// without scanning job_list
+		std::optional<typename JobList::iterator> previous_of_key{};
+		std::optional<typename JobList::iterator> next_of_key{};
+	};
+
+	struct PrefixNode
+	{
+		// Pending and running jobs of the keys under the node
+		std::size_t number_of_jobs{};
+		// Keys and nodes directly under the node that have had jobs since it was created
+		std::set<Key> children;
+	};
+
+	// Bounds the work (and the time the lock is released) of one sweep over expired or cancelled jobs.
+	static constexpr std::size_t max_discarded_jobs_per_sweep{ 64 };
+
+	static inline thread_local RunningJobFrame const* running_job_frame{};
+
+	// Jobs may be destroyed while mutex_for_condition_variable is held, and the last one using a stop
+	// source removes it from the map, so the map has its own mutex.
+	std::mutex mutex_for_stop_sources;
+	KeyMap<std::weak_ptr<std::stop_source>> stop_source_map;
+	Mutex mutex_for_condition_variable;
+	ConditionVariable job_condition_variable;
+	ConditionVariable join_condition_variable;
+	ConditionVariable add_condition_variable;
+	[[no_unique_address]] std::conditional_t<std::is_void_v<typename QueuePolicy::MemoryResource>, std::monostate, typename QueuePolicy::MemoryResource> memory_resource;
+	// Shared with the entries of a KeyTable, which KeyIds may keep alive after the queue is gone
+	std::shared_ptr<KeyStateTable> key_table{ std::make_shared<KeyStateTable>() };
+	// Cancelled jobs still in job_list or deferred_job_list
+	std::size_t number_of_stale_jobs{};
+	// Nodes above keys of a HierarchicalKey, while they have pending or running jobs under them.
+	KeyMap<PrefixNode> prefix_map;
+	JobList job_list{ GetAllocator<PendingJob>() };
+	// Jobs that may not run before a given time; they move to job_list once due.
+	JobList deferred_job_list{ GetAllocator<PendingJob>() };
+	TimeIndex expiry_index{ GetAllocator<typename TimeIndex::value_type>() };
+	TimeIndex deferred_index{ GetAllocator<typename TimeIndex::value_type>() };
+	std::size_t number_of_in_progress_jobs{};
+	std::size_t number_of_joining_threads{};
+	std::size_t number_of_idle_threads{};
+	// Bumped under the lock whenever a job is queued, deferred or becomes due, so idle workers can
+	// spin on it without taking the lock.
+	std::atomic_size_t job_epoch{};
+	std::size_t number_of_waiting_producers{};
+	std::size_t capacity{ std::numeric_limits<std::size_t>::max() };
+	std::size_t key_capacity{ std::numeric_limits<std::size_t>::max() };
+	std::chrono::steady_clock::duration debounce_interval{};
+	CallerRunsPolicy caller_runs_policy;
+	std::optional<CoDelController> codel_controller;
+	typename CoDelPolicy<Key>::ShedFilter shed_filter;
+	std::function<void(Key const&)> expired_job_handler;
+	JobQueueMetrics metrics;
+	std::vector<std::jthread> thread_pool;
+
+	template <typename T>
+	Allocator<T> GetAllocator()
+	{
+		if constexpr (std::is_void_v<typename QueuePolicy::MemoryResource>)
+		{
+			return {};
+		}
+		else
+		{
+			return { &memory_resource };
+		}
+	}
+
+	// Jobs that take a std::stop_token share their key's stop source until the key is cancelled.
+	template <typename... Ts, typename K, typename Func>
+	decltype(auto) BindStopToken(K const& key, Func&& func)
+	{
+		if constexpr (std::invocable<Func, std::stop_token, Ts...>)
+		{
+			return [stop_source = GetStopSource(key), func = std::forward<Func>(func)] <typename... Xs>(Xs&&... xs) mutable -> decltype(auto) {
+				return std::invoke(std::move(func), stop_source->get_token(), std::forward<Xs>(xs)...);
+			};
+		}
+		else
+		{
+			return std::forward<Func>(func);
+		}
+	}
+
+	template <typename K>
+	std::shared_ptr<std::stop_source> GetStopSource(K const& key)
+	{
+		std::lock_guard lk{ mutex_for_stop_sources };
+
+		auto it{ stop_source_map.find(ToLookupKey(key)) };
+
+		if (it == std::end(stop_source_map))
+		{
+			it = stop_source_map.try_emplace(Key{ key }).first;
+		}
+
+		auto& weak_stop_source{ it->second };
+
+		if (auto stop_source{ weak_stop_source.lock() })
+		{
+			return stop_source;
+		}
+
+		std::shared_ptr<std::stop_source> stop_source{ new std::stop_source, [this, key = it->first](std::stop_source* stop_source) {
+			std::unique_lock lk{ mutex_for_stop_sources };
+
+			if (auto it{ stop_source_map.find(key) }; it != std::end(stop_source_map) && it->second.expired())
+			{
+				stop_source_map.erase(it);
+			}
+
+			lk.unlock();
+
+			delete stop_source;
+		} };
+
+		weak_stop_source = stop_source;
+
+		return stop_source;
+	}
+
+	// Stop callbacks run on the calling thread, so the sources are fired without holding a lock.
+	template <typename... Ts>
+	void RequestStop(Ts const&... ts)
+	{
+		RequestStopWith([this, &ts...](auto const& take) {
+			if constexpr (sizeof...(Ts) == 0)
+			{
+				while (!std::empty(stop_source_map))
+				{
+					take(std::begin(stop_source_map));
+				}
+			}
+			else
+			{
+				auto const take_key{ [this, &take](auto const& key) {
+					if (auto it{ stop_source_map.find(ToLookupKey(key)) }; it != std::end(stop_source_map))
+					{
+						take(it);
+					}
+				} };
+
+				(take_key(ts), ...);
+			}
+		});
+	}
+
+	template <std::ranges::input_range Range>
+		requires (!KeyLike<Range, Key>)
+	void RequestStop(Range const& keys)
+	{
+		RequestStopWith([this, &keys](auto const& take) {
+			for (auto const& key : keys)
+			{
+				if (auto it{ stop_source_map.find(ToLookupKey(key)) }; it != std::end(stop_source_map))
+				{
+					take(it);
+				}
+			}
+		});
+	}
+
+	// select is called with stop_source_map locked and a take function that erases an entry and
+	// returns the next iterator. The taken sources are fired after the lock is released.
+	template <typename Select>
+	void RequestStopWith(Select select)
+	{
+		std::vector<std::shared_ptr<std::stop_source>> stop_sources;
+
+		auto const take{ [this, &stop_sources](auto it) {
+			if (auto stop_source{ it->second.lock() })
+			{
+				stop_sources.push_back(std::move(stop_source));
+			}
+
+			return stop_source_map.erase(it);
+		} };
+
+		std::unique_lock lk{ mutex_for_stop_sources };
+
+		select(take);
+
+		lk.unlock();
+
+		for (auto& stop_source : stop_sources)
+		{
+			stop_source->request_stop();
+		}
+	}
+
+	template <typename K, typename Func, typename... Ts>
+	bool TryAddUntil(K const& key, std::chrono::steady_clock::time_point deadline, Func&& func, Ts&&... ts)
+	{
+		auto job{ [this] <typename... Xs>(Xs&&... xs) {
+			std::invoke(std::forward<Xs>(xs)...);
+		} };
+
+		return Submit(key_table->Intern(ToLookupKey(key)), std::async(std::launch::deferred, job, BindStopToken<Ts...>(key, std::forward<Func>(func)), std::forward<Ts>(ts)...), deadline);
+	}
+
+	template <typename K>
+	std::size_t GetPendingJobCount(K const& key) const
+	{
+		auto const key_state{ key_table->Find(ToLookupKey(key)) };
+
+		return key_state ? key_state->number_of_pending_jobs : 0;
+	}
+
+	std::size_t GetNumberOfPendingJobs() const
+	{
+		return std::size(job_list) + std::size(deferred_job_list) - number_of_stale_jobs;
+	}
+
+	// Waits until key has a free slot or deadline passes. A producer that is itself one of
+	// this queue's jobs runs pending jobs instead of blocking, so a full queue cannot deadlock the pool.
+	bool WaitForCapacity(std::unique_lock<Mutex>& lk, KeyState const& key_state, std::chrono::steady_clock::time_point deadline)
+	{
+		while (true)
+		{
+			auto const key_full{ key_state.number_of_pending_jobs >= key_capacity };
+
+			if (!key_full && GetNumberOfPendingJobs() < capacity)
+			{
+				return true;
+			}
+
+			if (CountRunningJobFrames() != 0)
+			{
+				auto const it{ key_full ? FindKeyJob(key_state) : std::begin(job_list) };
+
+				if (it != std::end(job_list))
+				{
+					RunJob(lk, it);
+
+					continue;
+				}
+			}
+
+			if (deadline == std::chrono::steady_clock::time_point::min())
+			{
+				return false;
+			}
+
+			++number_of_waiting_producers;
+
+			if (deadline == std::chrono::steady_clock::time_point::max())
+			{
+				add_condition_variable.wait(lk);
+			}
+			else if (add_condition_variable.wait_until(lk, deadline) == std::cv_status::timeout)
+			{
+				deadline = std::chrono::steady_clock::time_point::min();
+			}
+
+			--number_of_waiting_producers;
+		}
+	}
+
+	bool Submit(KeyStateHandle key_state, std::future<void>&& job,
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(),
+		std::chrono::steady_clock::time_point expiry = std::chrono::steady_clock::time_point::max())
+	{
+		std::unique_lock lk{ mutex_for_condition_variable };
+
+		// The key table rejected the key.
+		if (!key_state)
+		{
+			++metrics.number_of_rejected_jobs;
+
+			return false;
+		}
+
+		DiscardExpiredJobs(lk);
+
+		if (GetNumberOfPendingJobs() >= caller_runs_policy.max_pending_jobs
+			|| number_of_idle_threads < caller_runs_policy.min_idle_threads)
+		{
+			++metrics.number_of_inline_jobs;
+
+			AddToPrefixes(key_state->key);
+			Execute(lk, *key_state, job);
+
+			return true;
+		}
+
+		if (deadline != std::chrono::steady_clock::time_point::max()
+			&& codel_controller && codel_controller->Dropping()
+			&& (!shed_filter || shed_filter(key_state->key, {})))
+		{
+			++metrics.number_of_rejected_jobs;
+
+			return false;
+		}
+
+		if (!WaitForCapacity(lk, *key_state, deadline))
+		{
+			++metrics.number_of_rejected_jobs;
+
+			return false;
+		}
+
+		auto const it{ Enqueue(std::move(key_state), std::move(job), false) };
+
+		if (expiry != std::chrono::steady_clock::time_point::max())
+		{
+			it->expiry_it = expiry_index.emplace(expiry, it);
+		}
+
+		NotifyJobAdded(lk);
+
+		return true;
+	}
+
+	void SubmitOrReplace(KeyStateHandle key_state, std::future<void>&& job)
+	{
+		std::unique_lock lk{ mutex_for_condition_variable };
+
+		if (!key_state)
+		{
+			++metrics.number_of_rejected_jobs;
+
+			return;
+		}
+
+		// WaitForCapacity may release the lock, so look for the job to replace only afterwards.
+		if (!key_state->coalescing_job)
+		{
+			WaitForCapacity(lk, *key_state, std::chrono::steady_clock::time_point::max());
+		}
+
+		if (key_state->coalescing_job)
+		{
+			auto const it{ *key_state->coalescing_job };
+			auto replaced_job{ std::exchange(it->job, std::move(job)) };
+
+			++metrics.number_of_coalesced_jobs;
+
+			if (debounce_interval != std::chrono::steady_clock::duration::zero())
+			{
+				Defer(it, std::chrono::steady_clock::now() + debounce_interval);
+			}
+
+			// Destroy the replaced job outside the lock.
+			lk.unlock();
+
+			return;
+		}
+
+		auto const it{ Enqueue(key_state, std::move(job), true) };
+
+		key_state->coalescing_job = it;
+
+		if (debounce_interval != std::chrono::steady_clock::duration::zero())
+		{
+			Defer(it, std::chrono::steady_clock::now() + debounce_interval);
+		}
+
+		NotifyJobAdded(lk);
+	}
+
+	void SubmitDelayed(KeyStateHandle key_state, std::future<void>&& job, std::chrono::steady_clock::time_point not_before)
+	{
+		std::unique_lock lk{ mutex_for_condition_variable };
+
+		if (!key_state)
+		{
+			++metrics.number_of_rejected_jobs;
+
+			return;
+		}
+
+		WaitForCapacity(lk, *key_state, std::chrono::steady_clock::time_point::max());
+		Defer(Enqueue(std::move(key_state), std::move(job), false), not_before);
+		NotifyJobAdded(lk);
+	}
+
+	typename JobList::iterator Enqueue(KeyStateHandle key_state, std::future<void>&& job, bool coalescing)
+	{
+		auto& state{ *key_state };
+		auto const it{ job_list.insert(std::end(job_list), { std::move(key_state), state.generation, std::move(job), std::chrono::steady_clock::now(), std::end(expiry_index), std::end(deferred_index), coalescing }) };
+
+		it->previous_of_key = state.last_job;
+		(state.last_job ? (*state.last_job)->next_of_key : state.first_job) = it;
+		state.last_job = it;
+
+		++state.number_of_pending_jobs;
+		AddToPrefixes(state.key);
+
+		return it;
+	}
+
+	void NotifyJobAdded(std::unique_lock<Mutex>& lk)
+	{
+		auto const notify_joining_threads{ number_of_joining_threads != 0 };
+
+		job_epoch.fetch_add(1, std::memory_order_relaxed);
+
+		lk.unlock();
+
+		job_condition_variable.notify_one();
+
+		if (notify_joining_threads)
+		{
+			join_condition_variable.notify_all();
+		}
+	}
+
+	// Moves the job at it (from job_list or deferred_job_list) to deferred_job_list until not_before.
+	void Defer(typename JobList::iterator it, std::chrono::steady_clock::time_point not_before)
+	{
+		if (it->deferred_it != std::end(deferred_index))
+		{
+			deferred_index.erase(it->deferred_it);
+		}
+		else
+		{
+			deferred_job_list.splice(std::end(deferred_job_list), job_list, it);
+		}
+
+		it->deferred_it = deferred_index.emplace(not_before, it);
+	}
+
+	void PromoteDeferredJobs()
+	{
+		auto const now{ std::empty(deferred_index) ? std::chrono::steady_clock::time_point{} : std::chrono::steady_clock::now() };
+
+		while (!std::empty(deferred_index) && std::begin(deferred_index)->first <= now)
+		{
+			auto const it{ std::begin(deferred_index)->second };
+
+			job_list.splice(std::end(job_list), deferred_job_list, it);
+			it->deferred_it = std::end(deferred_index);
+			deferred_index.erase(std::begin(deferred_index));
+
+			job_epoch.fetch_add(1, std::memory_order_relaxed);
+			job_condition_variable.notify_one();
+		}
+	}
+
+	template <typename K>
+	std::size_t CancelKey(K const& key)
+	{
+		auto const key_state{ key_table->Find(ToLookupKey(key)) };
+
+		return key_state ? CancelKeyState(*key_state) : 0;
+	}
+
+	std::size_t CancelKeyState(KeyState& key_state)
+	{
+		auto const number_of_pending_jobs{ std::exchange(key_state.number_of_pending_jobs, 0) };
+
+		if (number_of_pending_jobs != 0)
+		{
+			++key_state.generation;
+			key_state.coalescing_job.reset();
+			number_of_stale_jobs += number_of_pending_jobs;
+			RemoveFromPrefixes(key_state.key, number_of_pending_jobs);
+		}
+
+		return number_of_pending_jobs;
+	}
+
+	// A job counts under the nodes above its key from Enqueue (or an inline Execute) until it
+	// finishes, expires, is shed or is cancelled.
+	void AddToPrefixes(Key const& key)
+	{
+		if constexpr (HierarchicalKey<Key>)
+		{
+			Key child{ key };
+
+			for (auto parent{ KeyHierarchy<Key>::Parent(child) }; parent; parent = KeyHierarchy<Key>::Parent(child))
+			{
+				auto& node{ prefix_map[*parent] };
+
+				++node.number_of_jobs;
+				node.children.insert(child);
+				child = std::move(*parent);
+			}
+		}
+	}
+
+	void RemoveFromPrefixes(Key const& key, std::size_t number_of_jobs)
+	{
+		if constexpr (HierarchicalKey<Key>)
+		{
+			for (auto parent{ KeyHierarchy<Key>::Parent(key) }; parent; parent = KeyHierarchy<Key>::Parent(*parent))
+			{
+				auto const it{ prefix_map.find(*parent) };
+
+				it->second.number_of_jobs -= number_of_jobs;
+
+				if (it->second.number_of_jobs == 0)
+				{
+					prefix_map.erase(it);
+				}
+			}
+		}
+	}
+
+	static bool IsUnderPrefix(Key const& key, Key const& prefix)
+	{
+		if (key == prefix)
+		{
+			return true;
+		}
+
+		for (auto parent{ KeyHierarchy<Key>::Parent(key) }; parent; parent = KeyHierarchy<Key>::Parent(*parent))
+		{
+			if (*parent == prefix)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void CollectSubtree(Key const& prefix, std::vector<Key>& keys) const
+	{
+		keys.push_back(prefix);
+
+		if (auto it{ prefix_map.find(prefix) }; it != std::end(prefix_map))
+		{
+			for (auto const& child : it->second.children)
+			{
+				CollectSubtree(child, keys);
+			}
+		}
+	}
+
+	// Runs pending jobs found by find on the calling thread until ready returns true.
+	template <typename Predicate, typename Finder>
+	void JoinUntil(Predicate ready, Finder find)
+	{
+		std::unique_lock lk{ mutex_for_condition_variable };
+
+		++number_of_joining_threads;
+
+		ScopeExit const leave{ [this] {
+			--number_of_joining_threads;
+		} };
+
+		while (!ready())
+		{
+			PromoteDeferredJobs();
+
+			if (auto it{ find() }; it != std::end(job_list))
+			{
+				RunJob(lk, it);
+			}
+			else if (!std::empty(deferred_index))
+			{
+				// Copied, since the index entry may be erased while the lock is released.
+				auto const not_before{ std::begin(deferred_index)->first };
+
+				join_condition_variable.wait_until(lk, not_before);
+			}
+			else
+			{
+				join_condition_variable.wait(lk);
+			}
+		}
+	}
+
+	template <typename... Ts>
+	auto FindJob(Ts const&... ts)
+	{
+		if constexpr (sizeof...(Ts) == 0)
+		{
+			return std::begin(job_list);
+		}
+		else
+		{
+			auto it{ std::end(job_list) };
+
+			(((it = FindKeyJob(ts)) != std::end(job_list)) || ...);
 
-struct NoKey
-{
-	// Nothing
-};
+			return it;
+		}
+	}
 
-template <typename Key = NoKey>
-class AsyncJobQueue final
-{
-public:
-	explicit AsyncJobQueue(std::size_t number_of_threads = std::thread::hardware_concurrency() * 2)
-		: thread_pool{ number_of_threads }
+	template <typename K>
+	typename JobList::iterator FindKeyJob(K const& key)
 	{
-		std::ranges::generate(thread_pool, [this] {
-			return std::jthread{ std::bind_front(&AsyncJobQueue::JobDispatcherThread, this) };
-		});
+		auto const key_state{ key_table->Find(ToLookupKey(key)) };
+
+		return key_state ? FindKeyJob(*key_state) : std::end(job_list);
 	}
 
-	~AsyncJobQueue()
+	// Returns the oldest job of the key in job_list, or std::end(job_list) if all are deferred.
+	typename JobList::iterator FindKeyJob(KeyState const& key_state)
 	{
-		for (auto& t : thread_pool)
+		for (auto it{ key_state.first_job }; it; it = (*it)->next_of_key)
 		{
-			t.request_stop();
+			if ((*it)->deferred_it == std::end(deferred_index))
+			{
+				return *it;
+			}
 		}
 
-		job_condition_variable.notify_all();
+		return std::end(job_list);
 	}
 
-	template <typename Func, typename... Ts>
-	requires std::is_same_v<std::invoke_result_t<Func, Ts...>, void>
-	void Add(Key const& key, Func&& func, Ts&&... ts)
+	template <typename K>
+	std::size_t GetInProgressJobCount(K const& key) const
 	{
-		auto job{ [this] <typename... Xs>(Xs&&... xs) {
-			std::invoke(std::forward<Xs>(xs)...);
-		} };
+		auto const key_state{ key_table->Find(ToLookupKey(key)) };
 
-		std::unique_lock lk{ mutex_for_condition_variable };
+		return key_state ? key_state->number_of_in_progress_jobs : 0;
+	}
+
+	// A key of another type is passed on as it is if it compares with Key directly, e.g. std::string_view
+	// for std::string keys, and is converted to Key otherwise.
+	template <typename K>
+	static decltype(auto) ToLookupKey(K const& key)
+	{
+		if constexpr (std::is_same_v<K, Key> || std::totally_ordered_with<Key, K>)
+		{
+			return (key);
+		}
+		else
+		{
+			return Key{ key };
+		}
+	}
 
-		job_list.emplace_back(key, std::async(std::launch::deferred, job, std::forward<Func>(func), std::forward<Ts>(ts)...));
-		++pending_job_count_map[key];
+	template <typename... Ts>
+	std::size_t CountRunningJobFrames(Ts const&... ts) const
+	{
+		std::size_t count{};
 
-		lk.unlock();
+		for (auto frame{ running_job_frame }; frame != nullptr; frame = frame->parent)
+		{
+			if (frame->queue == this && ((frame->key_state->key == ToLookupKey(ts)) && ...))
+			{
+				++count;
+			}
+		}
 
-		job_condition_variable.notify_one();
+		return count;
 	}
 
-	template <typename Func, typename... Ts, std::invocable<std::invoke_result_t<Func, Ts...>> Callback>
-	void AddWithCallback(Key const& key, Callback&& callback, Func&& func, Ts&&... ts)
+	static bool IsStale(PendingJob const& pending_job)
 	{
-		if constexpr (std::is_same_v<std::invoke_result_t<Func, Ts...>, void>)
-		{
-			auto job{ [this] <typename... Xs>(Callback&& callback, Xs&&... xs) {
-				std::invoke(std::forward<Xs>(xs)...);
-				std::invoke(std::forward<Callback>(callback));
-			} };
+		return pending_job.generation != pending_job.key_state->generation;
+	}
 
-			std::lock_guard lk{ mutex_for_condition_variable };
+	// Removes the job at it from job_list and the expiry index; the pending counts are up to the caller.
+	PendingJob UnlinkJob(typename JobList::iterator it)
+	{
+		auto& key_state{ *it->key_state };
 
-			job_list.emplace_back(key, std::async(std::launch::deferred, job, std::forward<Callback>(callback), std::forward<Func>(func), std::forward<Ts>(ts)...));
-			++pending_job_count_map[key];
-		}
-		else
-		{
-			auto job{ [this] <typename... Xs>(Callback&& callback, Xs&&... xs) {
-				std::invoke(std::forward<Callback>(callback), std::invoke(std::forward<Xs>(xs)...));
-			} };
-			
-			std::lock_guard lk{ mutex_for_condition_variable };
+		(it->previous_of_key ? (*it->previous_of_key)->next_of_key : key_state.first_job) = it->next_of_key;
+		(it->next_of_key ? (*it->next_of_key)->previous_of_key : key_state.last_job) = it->previous_of_key;
+
+		auto pending_job{ std::move(*it) };
+
+		job_list.erase(it);
 
-			job_list.emplace_back(key, std::async(std::launch::deferred, job, std::forward<Callback>(callback), std::forward<Func>(func), std::forward<Ts>(ts)...));
-			++pending_job_count_map[key];
+		if (pending_job.expiry_it != std::end(expiry_index))
+		{
+			expiry_index.erase(pending_job.expiry_it);
 		}
 
-		job_condition_variable.notify_one();
+		return pending_job;
 	}
 
-	template <typename... Ts>
-	void Join(Ts const&... ts)
+	PendingJob PopJob(typename JobList::iterator it)
 	{
-		std::unique_lock lk{ mutex_for_condition_variable };
+		auto pending_job{ UnlinkJob(it) };
 
-		if constexpr (sizeof...(Ts) == 0)
-		{		
-			join_condition_variable.wait(lk, [this] {
-				return std::empty(job_list) && std::empty(pending_job_count_map) && std::empty(in_progress_job_count_map);
-			});
+		if (pending_job.coalescing)
+		{
+			pending_job.key_state->coalescing_job.reset();
 		}
-		else
+
+		--pending_job.key_state->number_of_pending_jobs;
+
+		NotifyWaitingProducers();
+
+		return pending_job;
+	}
+
+	void NotifyWaitingProducers()
+	{
+		if (number_of_waiting_producers != 0)
 		{
-			join_condition_variable.wait(lk, [this, &ts...] {
-				return Ready(ts...);
-			});
+			if (key_capacity != std::numeric_limits<std::size_t>::max())
+			{
+				add_condition_variable.notify_all();
+			}
+			else
+			{
+				add_condition_variable.notify_one();
+			}
 		}
 	}
 
-	template <typename... Ts>
-	bool Ready(Ts const&... ts) const
+	// Removes the cancelled job at it, and the cancelled jobs directly behind it, and destroys them
+	// with lk released.
+	void DiscardStaleJobs(std::unique_lock<Mutex>& lk, typename JobList::iterator it)
 	{
-		return std::empty(job_list)
-			&& (!pending_job_count_map.contains(ts) && ...)
-			&& (!in_progress_job_count_map.contains(ts) && ...);
+		std::vector<PendingJob> stale_jobs;
+
+		do
+		{
+			auto const next{ std::next(it) };
+
+			stale_jobs.push_back(UnlinkJob(it));
+			it = next;
+		} while (it != std::end(job_list)
+			&& IsStale(*it)
+			&& std::size(stale_jobs) < max_discarded_jobs_per_sweep);
+
+		number_of_stale_jobs -= std::size(stale_jobs);
+
+		NotifyWaitingProducers();
+
+		lk.unlock();
+
+		stale_jobs.clear();
+
+		lk.lock();
 	}
 
-	template <typename... Ts>
-	void Cancel(Ts const&... ts)
+	// Feeds the sojourn time of the job at it to the CoDel controller and, if it calls for a drop,
+	// sheds the oldest job accepted by shed_filter. Returns whether the job at it itself was shed.
+	bool ShedJob(typename JobList::iterator it)
 	{
-		std::unique_lock lk{ mutex_for_condition_variable };
+		auto const now{ std::chrono::steady_clock::now() };
 
-		if constexpr (sizeof...(Ts) == 0)
+		// The job at it is the only live one left; cancelled jobs awaiting the sweep do not count.
+		if (!codel_controller->ShouldDrop(now - it->enqueue_time, now, GetNumberOfPendingJobs() == 1))
 		{
-			job_list.clear();
-			pending_job_count_map.clear();
+			return false;
 		}
-		else
+
+		auto victim{ std::ranges::find_if(job_list, [this, now](auto const& pending_job) {
+			return !IsStale(pending_job)
+				&& (!shed_filter || shed_filter(pending_job.key_state->key, now - pending_job.enqueue_time));
+		}) };
+
+		if (victim == std::end(job_list))
 		{
-			std::erase_if(job_list, [&ts...](auto const& t) {
-				auto const& key{ std::get<0>(t) };
+			return false;
+		}
 
-				return ((key == ts) || ...);
-			});
-			(pending_job_count_map.erase(ts), ...);
+		auto const shed_it{ victim == it };
+
+		RemoveFromPrefixes(PopJob(victim).key_state->key, 1);
+		codel_controller->Drop(now);
+		++metrics.number_of_shed_jobs;
+
+		if (number_of_joining_threads != 0)
+		{
+			join_condition_variable.notify_all();
 		}
-	}
 
-private:
-	std::mutex mutex_for_condition_variable;
-	std::condition_variable job_condition_variable;
-	std::condition_variable join_condition_variable;
-	std::map<Key, std::size_t> in_progress_job_count_map;
-	std::map<Key, std::size_t> pending_job_count_map;
-	std::list<std::tuple<Key, std::future<void>>> job_list;
-	std::vector<std::jthread> thread_pool;
+		return shed_it;
+	}
 
-	void JobDispatcherThread(std::stop_token stop_token)
+	// Removes up to max_discarded_jobs_per_sweep expired jobs, reporting them to the expired job handler
+	// with lk released. Returns whether any job was removed.
+	bool DiscardExpiredJobs(std::unique_lock<Mutex>& lk)
 	{
-		while (true)
+		if (std::empty(expiry_index))
 		{
-			if (std::unique_lock lk{ mutex_for_condition_variable }; 
-				std::empty(job_list))
-			{
-				join_condition_variable.notify_all();
-				job_condition_variable.wait(lk, [this, &stop_token] { return stop_token.stop_requested() || !std::empty(job_list); });
+			return false;
+		}
 
-				if (stop_token.stop_requested() && std::empty(job_list))
-				{
-					break;
-				}
+		auto const now{ std::chrono::steady_clock::now() };
+		std::vector<PendingJob> expired_jobs;
+		std::vector<PendingJob> stale_jobs;
+
+		while (!std::empty(expiry_index)
+			&& std::begin(expiry_index)->first <= now
+			&& std::size(expired_jobs) + std::size(stale_jobs) < max_discarded_jobs_per_sweep)
+		{
+			// Cancelled jobs are dropped without being reported.
+			if (auto const it{ std::begin(expiry_index)->second }; IsStale(*it))
+			{
+				stale_jobs.push_back(UnlinkJob(it));
 			}
 			else
 			{
-				auto [key, job] { std::move(job_list.front()) };
+				expired_jobs.push_back(PopJob(it));
+				RemoveFromPrefixes(expired_jobs.back().key_state->key, 1);
+			}
+		}
 
-				job_list.pop_front();
+		if (std::empty(expired_jobs) && std::empty(stale_jobs))
+		{
+			return false;
+		}
 
-				auto& pending_job_count{ pending_job_count_map[key] };
+		number_of_stale_jobs -= std::size(stale_jobs);
+		metrics.number_of_expired_jobs += std::size(expired_jobs);
 
-				--pending_job_count;
+		if (number_of_joining_threads != 0)
+		{
+			join_condition_variable.notify_all();
+		}
 
-				if (pending_job_count == 0)
-				{
-					pending_job_count_map.erase(key);
-				}
+		auto handler{ expired_job_handler };
+
+		lk.unlock();
+
+		if (handler)
+		{
+			for (auto const& pending_job : expired_jobs)
+			{
+				handler(pending_job.key_state->key);
+			}
+		}
+
+		expired_jobs.clear();
+		stale_jobs.clear();
+
+		lk.lock();
+
+		return true;
+	}
+
+	// Must be called with lk held; lk is released while the job runs and held again on return.
+	void RunJob(std::unique_lock<Mutex>& lk, typename JobList::iterator it)
+	{
+		if (IsStale(*it))
+		{
+			DiscardStaleJobs(lk, it);
+
+			return;
+		}
+
+		if (it->expiry_it != std::end(expiry_index) && it->expiry_it->first <= std::chrono::steady_clock::now())
+		{
+			DiscardExpiredJobs(lk);
+
+			return;
+		}
+
+		if (codel_controller && ShedJob(it))
+		{
+			return;
+		}
+
+		auto pending_job{ PopJob(it) };
+
+		Execute(lk, *pending_job.key_state, pending_job.job);
+	}
+
+	void Execute(std::unique_lock<Mutex>& lk, KeyState& key_state, std::future<void>& job)
+	{
+		++key_state.number_of_in_progress_jobs;
+		++number_of_in_progress_jobs;
+
+		RunningJobFrame const frame{ this, &key_state, running_job_frame };
+
+		running_job_frame = &frame;
+
+		lk.unlock();
+
+		// If the job throws, the exception propagates to the caller with lk held again.
+		ScopeExit const finish{ [this, &lk, &key_state, &frame] {
+			lk.lock();
+
+			running_job_frame = frame.parent;
+
+			--number_of_in_progress_jobs;
+			--key_state.number_of_in_progress_jobs;
+
+			RemoveFromPrefixes(key_state.key, 1);
+
+			if (number_of_joining_threads != 0)
+			{
+				join_condition_variable.notify_all();
+			}
+		} };
+
+		job.get();
+	}
+
+	// Releases lk and yields up to QueuePolicy::idle_spin_count times until job_epoch moves on, then
+	// takes lk again once. Producers never wait for the lock on a spinning worker.
+	void SpinWhileIdle(std::unique_lock<Mutex>& lk, std::stop_token const& stop_token)
+	{
+		if constexpr (QueuePolicy::idle_spin_count != 0)
+		{
+			auto const epoch{ job_epoch.load(std::memory_order_relaxed) };
+
+			lk.unlock();
 
-				auto& in_progress_job_count{ in_progress_job_count_map[key] };
+			for (std::size_t i{}; i < QueuePolicy::idle_spin_count
+				&& job_epoch.load(std::memory_order_relaxed) == epoch && !stop_token.stop_requested(); ++i)
+			{
+				std::this_thread::yield();
+			}
 
-				++in_progress_job_count;
+			lk.lock();
+		}
+	}
 
-				lk.unlock();
+	void JobDispatcherThread(std::stop_token stop_token)
+	{
+		while (true)
+		{
+			std::unique_lock lk{ mutex_for_condition_variable };
 
-				job.get();
+			PromoteDeferredJobs();
 
-				lk.lock();
+			if (std::empty(job_list))
+			{
+				// Jobs left in deferred_job_list then are all cancelled ones.
+				if (stop_token.stop_requested() && GetNumberOfPendingJobs() == 0)
+				{
+					break;
+				}
 
-				--in_progress_job_count;
+				++number_of_idle_threads;
 
-				if (in_progress_job_count == 0)
+				if (std::empty(deferred_index))
 				{
-					in_progress_job_count_map.erase(key);
+					SpinWhileIdle(lk, stop_token);
+					job_condition_variable.wait(lk, [this, &stop_token] { return stop_token.stop_requested() || !std::empty(job_list) || !std::empty(deferred_index); });
+				}
+				else
+				{
+					// Copied, since the index entry may be erased while the lock is released.
+					auto const not_before{ std::begin(deferred_index)->first };
 
-					if (!pending_job_count_map.contains(key))
-					{
-						join_condition_variable.notify_all();
-					}
+					job_condition_variable.wait_until(lk, not_before);
 				}
+
+				--number_of_idle_threads;
+			}
+			else if (!DiscardExpiredJobs(lk))
+			{
+				RunJob(lk, std::begin(job_list));
 			}
 		}
 	}
 };
 
+class TaskGroup;
+
 template <>
 class AsyncJobQueue<NoKey> final
 {
@@ -207,60 +1717,196 @@ public:
 	~AsyncJobQueue();
 
 	template <typename Func, typename... Ts>
-	requires std::is_same_v<std::invoke_result_t<Func, Ts...>, void>
+	requires VoidJob<Func, Ts...>
 	void Add(Func&& func, Ts&&... ts)
 	{
 		auto job{ [this] <typename... Xs>(Xs&&... xs) {
 			std::invoke(std::forward<Xs>(xs)...);
 		} };
 
-		std::unique_lock lk{ mutex_for_condition_variable };
+		Submit(std::async(std::launch::deferred, job, BindStopToken<Ts...>(std::forward<Func>(func)), std::forward<Ts>(ts)...));
+	}
 
-		job_queue.push(std::async(std::launch::deferred, job, std::forward<Func>(func), std::forward<Ts>(ts)...));
+	// See AsyncJobQueue<Key>::AddBulk.
+	template <typename Kernel, std::ranges::sized_range Range>
+	requires BulkKernel<std::decay_t<Kernel>, std::ranges::range_value_t<Range>>
+	void AddBulk(Kernel&& kernel, Range const& args, std::size_t chunk_size = 0)
+	{
+		using Arg = std::ranges::range_value_t<Range>;
 
-		lk.unlock();
+		auto const shared_args{ std::make_shared<std::vector<Arg> const>(std::ranges::begin(args), std::ranges::end(args)) };
+		auto const shared_kernel{ std::make_shared<std::decay_t<Kernel> const>(std::forward<Kernel>(kernel)) };
+		auto const number_of_args{ std::size(*shared_args) };
 
-		job_condition_variable.notify_one();
+		if (chunk_size == 0)
+		{
+			chunk_size = std::max<std::size_t>(number_of_args / (std::max<std::size_t>(std::size(thread_pool), 1) * 4), 1);
+		}
+
+		for (std::size_t offset{}; offset < number_of_args; offset += chunk_size)
+		{
+			Add([shared_args, shared_kernel, offset, count = std::min(chunk_size, number_of_args - offset)] {
+				InvokeBulkKernel(*shared_kernel, std::span<Arg const>{ *shared_args }.subspan(offset, count));
+			});
+		}
+	}
+
+	// Expired jobs are only detected when they reach the front of the queue.
+	template <typename Func, typename... Ts>
+	requires VoidJob<Func, Ts...>
+	void AddWithExpiry(std::chrono::steady_clock::time_point expiry, Func&& func, Ts&&... ts)
+	{
+		auto job{ [this] <typename... Xs>(Xs&&... xs) {
+			std::invoke(std::forward<Xs>(xs)...);
+		} };
+
+		Submit(std::async(std::launch::deferred, job, BindStopToken<Ts...>(std::forward<Func>(func)), std::forward<Ts>(ts)...), std::chrono::steady_clock::time_point::max(), expiry);
+	}
+
+	template <typename Rep, typename Period, typename Func, typename... Ts>
+	requires VoidJob<Func, Ts...>
+	void AddWithTimeToLive(std::chrono::duration<Rep, Period> const& time_to_live, Func&& func, Ts&&... ts)
+	{
+		AddWithExpiry(std::chrono::steady_clock::now() + time_to_live, std::forward<Func>(func), std::forward<Ts>(ts)...);
+	}
+
+	template <typename Func, typename... Ts>
+	requires VoidJob<Func, Ts...>
+	bool TryAdd(Func&& func, Ts&&... ts)
+	{
+		return TryAddUntil(std::chrono::steady_clock::time_point::min(), std::forward<Func>(func), std::forward<Ts>(ts)...);
+	}
+
+	template <typename Rep, typename Period, typename Func, typename... Ts>
+	requires VoidJob<Func, Ts...>
+	bool TryAddFor(std::chrono::duration<Rep, Period> const& timeout, Func&& func, Ts&&... ts)
+	{
+		return TryAddUntil(std::chrono::steady_clock::now() + timeout, std::forward<Func>(func), std::forward<Ts>(ts)...);
 	}
 
-	template <typename Func, typename... Ts, std::invocable<std::invoke_result_t<Func, Ts...>> Callback>
+	template <typename Func, typename... Ts, std::invocable<JobResult<Func, Ts...>> Callback>
 	void AddWithCallback(Callback&& callback, Func&& func, Ts&&... ts)
 	{
-		if constexpr (std::is_same_v<std::invoke_result_t<Func, Ts...>, void>)
+		if constexpr (std::is_same_v<JobResult<Func, Ts...>, void>)
 		{
 			auto job{ [this] <typename... Xs>(Callback&& callback, Xs&&... xs) {
 				std::invoke(std::forward<Xs>(xs)...);
 				std::invoke(std::forward<Callback>(callback));
 			} };
 
-			std::lock_guard lk{ mutex_for_condition_variable };
-
-			job_queue.push(std::async(std::launch::deferred, job, std::move(callback), std::forward<Func>(func), std::forward<Ts>(ts)...));
+			Submit(std::async(std::launch::deferred, job, std::move(callback), BindStopToken<Ts...>(std::forward<Func>(func)), std::forward<Ts>(ts)...));
 		}
 		else
 		{
 			auto job{ [this] <typename... Xs>(Callback&& callback, Xs&&... xs) {
 				std::invoke(std::forward<Callback>(callback), std::invoke(std::forward<Xs>(xs)...));
 			} };
-			
-			std::lock_guard lk{ mutex_for_condition_variable };
 
-			job_queue.push(std::async(std::launch::deferred, job, std::move(callback), std::forward<Func>(func), std::forward<Ts>(ts)...));
+			Submit(std::async(std::launch::deferred, job, std::move(callback), BindStopToken<Ts...>(std::forward<Func>(func)), std::forward<Ts>(ts)...));
 		}
-
-		job_condition_variable.notify_one();
 	}
 
+	void SetCallerRunsPolicy(CallerRunsPolicy const& policy);
+	void SetCapacity(std::size_t capacity);
+	void SetCoDelPolicy(std::optional<CoDelPolicy<>> const& policy);
+	void SetExpiredJobHandler(std::function<void()> handler);
+	JobQueueMetrics GetMetrics();
+	std::size_t GetNumberOfThreads() const;
+	// Index of the calling worker thread in [0, GetNumberOfThreads()), or GetNumberOfThreads() for any other thread.
+	std::size_t GetWorkerIndex() const;
+
+	// Runs pending jobs on the calling thread while waiting; see AsyncJobQueue<Key>::Join. Jobs that wait
+	// only for the jobs they spawn, while others do the same, use a TaskGroup.
 	void Join();
+	// Also fires the stop token passed to pending and running jobs. Jobs spawned by a TaskGroup are not
+	// cancelled; the group's Sync still waits for them.
 	void Cancel();
 
 private:
+	friend class TaskGroup;
+
+	struct RunningJobFrame
+	{
+		AsyncJobQueue const* queue;
+		RunningJobFrame const* parent;
+	};
+
+	struct SpawnedJob
+	{
+		std::future<void> job;
+		void const* group;
+	};
+
+	// A syncing thread only steals while it is nested less deeply than this in jobs of this queue,
+	// which bounds the stack growth caused by running unrelated jobs inside a Sync.
+	static constexpr std::size_t max_stealing_depth{ 64 };
+
+	struct PendingJob
+	{
+		std::future<void> job;
+		std::chrono::steady_clock::time_point enqueue_time;
+		std::chrono::steady_clock::time_point expiry;
+	};
+
+	static thread_local RunningJobFrame const* running_job_frame;
+	static thread_local AsyncJobQueue const* worker_queue;
+	static thread_local std::size_t worker_index;
+
 	std::mutex mutex_for_condition_variable;
 	std::condition_variable job_condition_variable;
 	std::condition_variable join_condition_variable;
-	std::queue<std::future<void>> job_queue;
+	std::condition_variable add_condition_variable;
+	std::queue<PendingJob> job_queue;
+	std::stop_source stop_source;
+	// One deque per worker plus a shared one for other threads; the owner takes from the back, thieves from the front.
+	std::vector<std::deque<SpawnedJob>> spawned_job_deques;
+	std::size_t number_of_spawned_jobs{};
+	std::size_t number_of_running_jobs{};
+	std::size_t number_of_joining_threads{};
+	std::size_t number_of_idle_threads{};
+	std::size_t number_of_waiting_producers{};
+	std::size_t capacity{ std::numeric_limits<std::size_t>::max() };
+	CallerRunsPolicy caller_runs_policy;
+	std::optional<CoDelController> codel_controller;
+	CoDelPolicy<>::ShedFilter shed_filter;
+	std::function<void()> expired_job_handler;
+	JobQueueMetrics metrics;
 	std::vector<std::jthread> thread_pool;
-	std::size_t number_of_busy_threads;
 
-	void JobDispatcherThread(std::stop_token stop_token);
+	template <typename... Ts, typename Func>
+	decltype(auto) BindStopToken(Func&& func)
+	{
+		if constexpr (std::invocable<Func, std::stop_token, Ts...>)
+		{
+			return std::bind_front(std::forward<Func>(func), GetStopToken());
+		}
+		else
+		{
+			return std::forward<Func>(func);
+		}
+	}
+
+	template <typename Func, typename... Ts>
+	bool TryAddUntil(std::chrono::steady_clock::time_point deadline, Func&& func, Ts&&... ts)
+	{
+		auto job{ [this] <typename... Xs>(Xs&&... xs) {
+			std::invoke(std::forward<Xs>(xs)...);
+		} };
+
+		return Submit(std::async(std::launch::deferred, job, BindStopToken<Ts...>(std::forward<Func>(func)), std::forward<Ts>(ts)...), deadline);
+	}
+
+	std::stop_token GetStopToken();
+	bool WaitForCapacity(std::unique_lock<std::mutex>& lk, std::chrono::steady_clock::time_point deadline);
+	bool Submit(std::future<void>&& job,
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(),
+		std::chrono::steady_clock::time_point expiry = std::chrono::steady_clock::time_point::max());
+	std::size_t CountRunningJobFrames() const;
+	bool ShedJob();
+	void RunJob(std::unique_lock<std::mutex>& lk);
+	void Execute(std::unique_lock<std::mutex>& lk, std::future<void>& job);
+	void Spawn(std::future<void>&& job, void const* group);
+	void Sync(void const* group, std::atomic_size_t const& number_of_pending_jobs);
+	bool RunSpawnedJob(std::unique_lock<std::mutex>& lk, std::size_t index, void const* group);
+	void JobDispatcherThread(std::size_t index, std::stop_token stop_token);
 };
@@ -0,0 +1,628 @@
+#include "Benchmark.h"
+#include "ParallelReduce.h"
+#include "ParallelAlgorithm.h"
+#include "TaskGroup.h"
+#include "Pipeline.h"
+#include "OrderedResults.h"
+#include "Channel.h"
+#include "VariantJobQueue.h"
+
+#include <iostream>
+#include <format>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <map>
+#include <string>
+#include <latch>
+
+using namespace std::literals;
+
+namespace
+{
+    enum class Shard : std::uint8_t
+    {
+        count = 16
+    };
+}
+
+template <>
+struct DenseKeyTraits<Shard>
+{
+    static constexpr std::size_t size{ static_cast<std::size_t>(Shard::count) };
+};
+
+namespace
+{
+    template <typename Func>
+    void Measure(std::string_view name, Func&& func)
+    {
+        auto const start{ std::chrono::steady_clock::now() };
+
+        auto const result{ func() };
+
+        auto const elapsed{ std::chrono::duration<double, std::milli>{ std::chrono::steady_clock::now() - start } };
+
+        std::cout << std::format("{:<48} {:>10.2f} ms  (result {})\n", name, elapsed.count(), result);
+    }
+
+    void BenchmarkReduce(AsyncJobQueue<>& job_queue)
+    {
+        constexpr long long n{ 100'000'000 };
+
+        Measure("Count: shared std::atomic_llong", [&] {
+            std::atomic_llong count;
+
+            ParallelFor(job_queue, 0LL, n, [&count](long long i) {
+                if (i % 3 == 0)
+                {
+                    ++count;
+                }
+            });
+
+            return count.load();
+        });
+
+        Measure("Count: ParallelReduce (per-worker slots)", [&] {
+            return ParallelReduce(job_queue, 0LL, n, 0LL, [](long long i) {
+                return i % 3 == 0 ? 1LL : 0LL;
+            }, std::plus{});
+        });
+    }
+
+    void BenchmarkAlgorithms(AsyncJobQueue<>& job_queue)
+    {
+        constexpr std::size_t n{ 10'000'000 };
+
+        std::vector<std::uint32_t> input(n);
+        std::mt19937 random_engine{ 42 };
+
+        std::ranges::generate(input, std::ref(random_engine));
+
+        std::vector<std::uint32_t> data;
+        std::vector<std::uint64_t> output(n);
+
+        data = input;
+        Measure("Sort: std::sort", [&] {
+            std::sort(std::begin(data), std::end(data));
+
+            return data[n / 2];
+        });
+
+        data = input;
+        Measure("Sort: Sort", [&] {
+            Sort(job_queue, data);
+
+            return data[n / 2];
+        });
+
+        Measure("Scan: std::inclusive_scan", [&] {
+            std::inclusive_scan(std::begin(input), std::end(input), std::begin(output), std::plus<std::uint64_t>{});
+
+            return output.back();
+        });
+
+        Measure("Scan: InclusiveScan", [&] {
+            InclusiveScan(job_queue, input, std::begin(output), std::plus<std::uint64_t>{});
+
+            return output.back();
+        });
+
+        Measure("Transform: std::transform", [&] {
+            std::transform(std::begin(input), std::end(input), std::begin(output), [](std::uint32_t x) { return std::uint64_t{ x } * x; });
+
+            return output.back();
+        });
+
+        Measure("Transform: Transform", [&] {
+            Transform(job_queue, input, std::begin(output), [](std::uint32_t x) { return std::uint64_t{ x } * x; });
+
+            return output.back();
+        });
+
+        Measure("CopyIf: std::copy_if", [&] {
+            return std::copy_if(std::begin(input), std::end(input), std::begin(data), [](std::uint32_t x) { return x % 3 == 0; }) - std::begin(data);
+        });
+
+        Measure("CopyIf: CopyIf", [&] {
+            return CopyIf(job_queue, input, std::begin(data), [](std::uint32_t x) { return x % 3 == 0; }) - std::begin(data);
+        });
+    }
+
+    template <std::random_access_iterator It>
+    void QuickSort(AsyncJobQueue<>& job_queue, It first, It last)
+    {
+        if (last - first < 4096)
+        {
+            std::sort(first, last);
+
+            return;
+        }
+
+        auto const pivot{ first[(last - first) / 2] };
+        auto const middle1{ std::partition(first, last, [pivot](auto const& x) { return x < pivot; }) };
+        auto const middle2{ std::partition(middle1, last, [pivot](auto const& x) { return !(pivot < x); }) };
+
+        TaskGroup task_group{ job_queue };
+
+        task_group.Spawn([&job_queue, first, middle1] { QuickSort(job_queue, first, middle1); });
+        QuickSort(job_queue, middle2, last);
+    }
+
+    void BenchmarkTaskGroup(AsyncJobQueue<>& job_queue)
+    {
+        constexpr std::size_t n{ 10'000'000 };
+
+        std::vector<std::uint32_t> data(n);
+        std::mt19937 random_engine{ 42 };
+
+        std::ranges::generate(data, std::ref(random_engine));
+
+        Measure("QuickSort: TaskGroup (Spawn/Sync)", [&] {
+            QuickSort(job_queue, std::begin(data), std::end(data));
+
+            return data[n / 2];
+        });
+    }
+
+    void BenchmarkPipeline(AsyncJobQueue<>& job_queue)
+    {
+        struct Record
+        {
+            std::uint64_t id;
+            std::vector<std::uint32_t> values;
+            std::uint64_t digest;
+        };
+
+        constexpr std::uint64_t n{ 100'000 };
+
+        std::uint64_t next_id{};
+        std::uint64_t written{};
+        PipelineMetrics metrics;
+
+        Pipeline<Record> pipeline{ job_queue };
+
+        pipeline
+            .AddStage(PipelineStageMode::Parallel, [](Record& record) {     // Parse
+                record.values.resize(256);
+                std::iota(std::begin(record.values), std::end(record.values), static_cast<std::uint32_t>(record.id));
+            })
+            .AddStage(PipelineStageMode::Parallel, [](Record& record) {     // Enrich
+                for (auto& value : record.values)
+                {
+                    value = value * 2654435761u;
+                }
+            })
+            .AddStage(PipelineStageMode::Parallel, [](Record& record) {     // Compress
+                record.digest = std::accumulate(std::begin(record.values), std::end(record.values), std::uint64_t{}, [](std::uint64_t digest, std::uint32_t value) {
+                    return (digest ^ value) * 1099511628211u;
+                });
+            })
+            .AddStage(PipelineStageMode::SerialInOrder, [&written](Record& record) {   // Write
+                written ^= record.digest + record.id;
+            });
+
+        Measure("Pipeline: parse/enrich/compress/write", [&] {
+            metrics = pipeline.Run([&next_id]() -> std::optional<Record> {
+                if (next_id == n)
+                {
+                    return std::nullopt;
+                }
+
+                return Record{ next_id++, {}, {} };
+            });
+
+            return written;
+        });
+
+        for (std::size_t i{}; i < std::size(metrics.stages); ++i)
+        {
+            auto const& stage{ metrics.stages[i] };
+
+            std::cout << std::format("  stage {}: {:>8} tokens, {:>6.1f}% busy, {:>8.2f} Mtokens/s, max {} buffered\n", i, stage.number_of_tokens,
+                100.0 * stage.busy_time.count() / metrics.elapsed.count(),
+                stage.number_of_tokens / std::chrono::duration<double, std::micro>{ stage.busy_time }.count(),
+                stage.max_buffered_tokens);
+        }
+    }
+
+    void BenchmarkOrderedResults(AsyncJobQueue<>& job_queue)
+    {
+        constexpr std::uint64_t n{ 200'000 };
+
+        auto const work{ [](std::uint64_t i) {
+            return i * 2654435761u;
+        } };
+
+        Measure("Ordered: AddWithCallback + mutex/map reorder", [&] {
+            std::mutex mutex;
+            std::map<std::uint64_t, std::uint64_t> pending;
+            std::uint64_t next{};
+            std::uint64_t digest{};
+
+            for (std::uint64_t i{}; i < n; ++i)
+            {
+                job_queue.AddWithCallback([&, i](std::uint64_t result) {
+                    std::lock_guard lk{ mutex };
+
+                    pending.emplace(i, result);
+
+                    for (auto it{ std::begin(pending) }; it != std::end(pending) && it->first == next; it = pending.erase(it), ++next)
+                    {
+                        digest = digest * 31 + it->second;
+                    }
+                }, work, i);
+            }
+
+            job_queue.Join();
+
+            return digest;
+        });
+
+        Measure("Ordered: OrderedResults (capacity 1024)", [&] {
+            std::uint64_t digest{};
+
+            OrderedResults<std::uint64_t> ordered_results{ job_queue, 1024, [&digest](std::uint64_t&& result) {
+                digest = digest * 31 + result;
+            } };
+
+            for (std::uint64_t i{}; i < n; ++i)
+            {
+                ordered_results.Add(work, i);
+            }
+
+            ordered_results.Join();
+
+            return digest;
+        });
+    }
+
+    DetachedTask Ping(AsyncJobQueue<>& job_queue, Channel<int>& request, Channel<int>& reply, int n, std::latch& done)
+    {
+        co_await ScheduleOn(job_queue);
+
+        for (auto i{ 0 }; i < n; ++i)
+        {
+            co_await request.Send(i);
+            co_await reply.Receive();
+        }
+
+        request.Close();
+        done.count_down();
+    }
+
+    DetachedTask Pong(AsyncJobQueue<>& job_queue, Channel<int>& request, Channel<int>& reply, std::latch& done)
+    {
+        co_await ScheduleOn(job_queue);
+
+        while (auto value{ co_await request.Receive() })
+        {
+            co_await reply.Send(*value);
+        }
+
+        done.count_down();
+    }
+
+    DetachedTask Produce(AsyncJobQueue<>& job_queue, Channel<std::uint64_t>& channel, std::uint64_t n, std::latch& done)
+    {
+        co_await ScheduleOn(job_queue);
+
+        for (std::uint64_t i{}; i < n; ++i)
+        {
+            co_await channel.Send(i);
+        }
+
+        done.count_down();
+    }
+
+    DetachedTask Consume(AsyncJobQueue<>& job_queue, Channel<std::uint64_t>& channel, std::uint64_t& sum, std::latch& done)
+    {
+        co_await ScheduleOn(job_queue);
+
+        while (auto value{ co_await channel.Receive() })
+        {
+            sum += *value;
+        }
+
+        done.count_down();
+    }
+
+    void BenchmarkChannel(AsyncJobQueue<>& job_queue)
+    {
+        constexpr int round_trips{ 100'000 };
+
+        Measure("Channel: ping-pong, ns per round trip (capacity 0)", [&] {
+            Channel<int> request{ job_queue, 0 };
+            Channel<int> reply{ job_queue, 0 };
+            std::latch done{ 2 };
+
+            auto const start{ std::chrono::steady_clock::now() };
+
+            Pong(job_queue, request, reply, done);
+            Ping(job_queue, request, reply, round_trips, done);
+
+            done.wait();
+
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / round_trips;
+        });
+
+        constexpr std::uint64_t number_of_producers{ 8 };
+        constexpr std::uint64_t n{ 200'000 };
+
+        Measure("Channel: fan-in, 8 producers (capacity 1024)", [&] {
+            Channel<std::uint64_t> channel{ job_queue, 1024 };
+            std::uint64_t sum{};
+            std::latch producers_done{ number_of_producers };
+            std::latch consumer_done{ 1 };
+
+            Consume(job_queue, channel, sum, consumer_done);
+
+            for (std::uint64_t i{}; i < number_of_producers; ++i)
+            {
+                Produce(job_queue, channel, n / number_of_producers, producers_done);
+            }
+
+            producers_done.wait();
+            channel.Close();
+            consumer_done.wait();
+
+            return sum;
+        });
+    }
+
+    template <typename KeyPolicy>
+    std::size_t RunKeyedJobs(std::vector<std::string> const& keys, std::size_t jobs_per_key)
+    {
+        AsyncJobQueue<std::string, KeyPolicy> job_queue;
+        std::atomic_size_t count;
+
+        for (std::size_t i{}; i < jobs_per_key; ++i)
+        {
+            for (auto const& key : keys)
+            {
+                job_queue.Add(key, [&count] { ++count; });
+            }
+        }
+
+        job_queue.Join();
+
+        return count.load();
+    }
+
+    template <typename KeyPolicy>
+    std::size_t RunInternedKeyedJobs(std::vector<std::string> const& keys, std::size_t jobs_per_key)
+    {
+        AsyncJobQueue<std::string, KeyPolicy> job_queue;
+        std::vector<typename AsyncJobQueue<std::string, KeyPolicy>::KeyId> key_ids;
+        std::atomic_size_t count;
+
+        for (auto const& key : keys)
+        {
+            key_ids.push_back(job_queue.Intern(key));
+        }
+
+        for (std::size_t i{}; i < jobs_per_key; ++i)
+        {
+            for (auto const& key_id : key_ids)
+            {
+                job_queue.Add(key_id, [&count] { ++count; });
+            }
+        }
+
+        job_queue.Join();
+
+        return count.load();
+    }
+
+    template <typename KeyPolicy, typename QueuePolicy = DefaultQueuePolicy>
+    std::size_t RunShardJobs(std::size_t n)
+    {
+        AsyncJobQueue<Shard, KeyPolicy, QueuePolicy> job_queue;
+        std::atomic_size_t count;
+
+        for (std::size_t i{}; i < n; ++i)
+        {
+            job_queue.Add(static_cast<Shard>(i % static_cast<std::size_t>(Shard::count)), [&count] { ++count; });
+        }
+
+        job_queue.Join();
+
+        return count.load();
+    }
+
+    // Adds one job at a time and waits for it, so that every job finds the workers idle.
+    template <typename QueuePolicy>
+    std::int64_t RunSequentialShardJobs(std::size_t n)
+    {
+        AsyncJobQueue<Shard, DenseKeyPolicy, QueuePolicy> job_queue;
+        std::atomic_size_t count;
+
+        auto const start{ std::chrono::steady_clock::now() };
+
+        for (std::size_t i{}; i < n; ++i)
+        {
+            job_queue.Add(static_cast<Shard>(i % static_cast<std::size_t>(Shard::count)), [&count] {
+                ++count;
+                count.notify_one();
+            });
+
+            count.wait(i);
+        }
+
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / static_cast<std::int64_t>(n);
+    }
+
+    // Insert, look up and erase every key, as the queue does for each job of a new key.
+    template <typename Map>
+    std::size_t ChurnKeys(std::vector<std::string> const& keys, std::size_t rounds)
+    {
+        Map map;
+        std::size_t sum{};
+
+        for (std::size_t i{}; i < rounds; ++i)
+        {
+            for (auto const& key : keys)
+            {
+                ++map[key];
+            }
+
+            for (auto const& key : keys)
+            {
+                sum += map.find(key)->second;
+            }
+
+            for (auto const& key : keys)
+            {
+                map.erase(key);
+            }
+        }
+
+        return sum;
+    }
+
+    void BenchmarkKeyPolicies()
+    {
+        constexpr std::size_t number_of_keys{ 100'000 };
+
+        std::vector<std::string> keys(number_of_keys);
+        std::mt19937 random_engine{ 42 };
+
+        // Long enough to defeat the small string optimization, and sharing a prefix as real keys tend to.
+        std::ranges::generate(keys, [&random_engine] { return std::format("tenant/session/{:016x}", random_engine()); });
+
+        Measure("Key maps: std::map, 100k keys x 10", [&] {
+            return ChurnKeys<std::map<std::string, std::size_t>>(keys, 10);
+        });
+
+        Measure("Key maps: FlatHashMap, 100k keys x 10", [&] {
+            return ChurnKeys<FlatHashMap<std::string, std::size_t>>(keys, 10);
+        });
+
+        Measure("Keyed jobs: OrderedKeyPolicy, 100k keys x 4", [&] {
+            return RunKeyedJobs<OrderedKeyPolicy>(keys, 4);
+        });
+
+        Measure("Keyed jobs: HashedKeyPolicy, 100k keys x 4", [&] {
+            return RunKeyedJobs<HashedKeyPolicy>(keys, 4);
+        });
+
+        Measure("Keyed jobs: HashedKeyPolicy, KeyId, 100k keys x 4", [&] {
+            return RunInternedKeyedJobs<HashedKeyPolicy>(keys, 4);
+        });
+
+        Measure("Enum keyed jobs: OrderedKeyPolicy, 16 keys", [&] {
+            return RunShardJobs<OrderedKeyPolicy>(1'000'000);
+        });
+
+        Measure("Enum keyed jobs: DenseKeyPolicy, 16 keys", [&] {
+            return RunShardJobs<DenseKeyPolicy>(1'000'000);
+        });
+    }
+
+    template <typename QueuePolicy>
+    void BenchmarkQueuePolicy(std::string_view name)
+    {
+        Measure(std::format("Queue policy: {}, 1M jobs", name), [] {
+            return RunShardJobs<DenseKeyPolicy, QueuePolicy>(1'000'000);
+        });
+
+        Measure(std::format("Queue policy: {}, ns per job run alone", name), [] {
+            return RunSequentialShardJobs<QueuePolicy>(100'000);
+        });
+    }
+
+    void BenchmarkQueuePolicies()
+    {
+        BenchmarkQueuePolicy<DefaultQueuePolicy>("default");
+        BenchmarkQueuePolicy<ThroughputQueuePolicy>("throughput");
+        BenchmarkQueuePolicy<LatencyQueuePolicy>("latency");
+        BenchmarkQueuePolicy<LowMemoryQueuePolicy>("low memory");
+    }
+
+    struct AddJob
+    {
+        std::atomic_uint64_t* sum;
+        std::uint64_t value;
+
+        void operator()() const
+        {
+            *sum += value;
+        }
+    };
+
+    struct CountJob
+    {
+        std::atomic_uint64_t* count;
+
+        void operator()() const
+        {
+            ++*count;
+        }
+    };
+
+    void BenchmarkVariantJobQueue()
+    {
+        constexpr std::uint64_t n{ 1'000'000 };
+
+        Measure("Small jobs: AsyncJobQueue<>", [&] {
+            AsyncJobQueue job_queue;
+            std::atomic_uint64_t sum;
+            std::atomic_uint64_t count;
+
+            for (std::uint64_t i{}; i < n; ++i)
+            {
+                if (i % 2 == 0)
+                {
+                    job_queue.Add(AddJob{ &sum, i });
+                }
+                else
+                {
+                    job_queue.Add(CountJob{ &count });
+                }
+            }
+
+            job_queue.Join();
+
+            return sum + count;
+        });
+
+        Measure("Small jobs: VariantJobQueue<AddJob, CountJob>", [&] {
+            VariantJobQueue<AddJob, CountJob> job_queue;
+            std::atomic_uint64_t sum;
+            std::atomic_uint64_t count;
+
+            for (std::uint64_t i{}; i < n; ++i)
+            {
+                if (i % 2 == 0)
+                {
+                    job_queue.Add(AddJob{ &sum, i });
+                }
+                else
+                {
+                    job_queue.Add(CountJob{ &count });
+                }
+            }
+
+            job_queue.Join();
+
+            return sum + count;
+        });
+    }
+}
+
+void RunBenchmarks()
+{
+    AsyncJobQueue job_queue;
+
+    BenchmarkReduce(job_queue);
+    BenchmarkAlgorithms(job_queue);
+    BenchmarkTaskGroup(job_queue);
+    BenchmarkPipeline(job_queue);
+    BenchmarkOrderedResults(job_queue);
+    BenchmarkChannel(job_queue);
+    BenchmarkKeyPolicies();
+    BenchmarkQueuePolicies();
+    BenchmarkVariantJobQueue();
+}
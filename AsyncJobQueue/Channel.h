@@ -0,0 +1,304 @@
+#pragma once
+
+#include "AsyncJobQueue.h"
+
+#include <coroutine>
+#include <exception>
+
+// Coroutine that starts running immediately and destroys itself when it finishes.
+struct DetachedTask
+{
+	struct promise_type
+	{
+		DetachedTask get_return_object() noexcept
+		{
+			return {};
+		}
+
+		std::suspend_never initial_suspend() noexcept
+		{
+			return {};
+		}
+
+		std::suspend_never final_suspend() noexcept
+		{
+			return {};
+		}
+
+		void return_void() noexcept
+		{
+		}
+
+		void unhandled_exception() noexcept
+		{
+			std::terminate();
+		}
+	};
+};
+
+// co_await ScheduleOn(job_queue) continues the coroutine as a job on job_queue.
+class ScheduleOn final
+{
+public:
+	explicit ScheduleOn(AsyncJobQueue<>& job_queue)
+		: job_queue{ job_queue }
+	{
+	}
+
+	bool await_ready() const noexcept
+	{
+		return false;
+	}
+
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		job_queue.Add([handle] { handle.resume(); });
+	}
+
+	void await_resume() const noexcept
+	{
+	}
+
+private:
+	AsyncJobQueue<>& job_queue;
+};
+
+// Multi-producer, multi-consumer channel between jobs. A Send on a full channel or a Receive on an empty
+// one parks only the coroutine or continuation, never the worker thread; it is resumed as a job on
+// job_queue once a partner arrives. Capacity 0 makes every Send wait for a Receive, as in Go.
+// Send reports false and Receive returns nothing once the channel is closed (and drained).
+template <typename T>
+class Channel final
+{
+public:
+	static constexpr std::size_t unbounded{ std::numeric_limits<std::size_t>::max() };
+
+	explicit Channel(AsyncJobQueue<>& job_queue, std::size_t capacity = unbounded)
+		: job_queue{ job_queue }
+		, capacity{ capacity }
+	{
+	}
+
+	Channel(Channel const&) = delete;
+	Channel& operator=(Channel const&) = delete;
+
+	// co_await channel.Send(value) -> bool
+	auto Send(T value)
+	{
+		struct Awaiter
+		{
+			Channel& channel;
+			T value;
+			bool sent{};
+
+			bool await_ready() const noexcept
+			{
+				return false;
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle)
+			{
+				return channel.TrySend(value, sent, [this, handle, &job_queue = channel.job_queue](bool sent) {
+					this->sent = sent;
+					job_queue.Add([handle] { handle.resume(); });
+				});
+			}
+
+			bool await_resume() const noexcept
+			{
+				return sent;
+			}
+		};
+
+		return Awaiter{ *this, std::move(value), false };
+	}
+
+	// co_await channel.Receive() -> std::optional<T>
+	auto Receive()
+	{
+		struct Awaiter
+		{
+			Channel& channel;
+			std::optional<T> value;
+
+			bool await_ready() const noexcept
+			{
+				return false;
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle)
+			{
+				return channel.TryReceive(value, [this, handle, &job_queue = channel.job_queue](std::optional<T>&& value) {
+					this->value = std::move(value);
+					job_queue.Add([handle] { handle.resume(); });
+				});
+			}
+
+			std::optional<T> await_resume() noexcept
+			{
+				return std::move(value);
+			}
+		};
+
+		return Awaiter{ *this, std::nullopt };
+	}
+
+	// Continuation forms: the continuation always runs as a job on job_queue.
+	template <std::invocable<bool> Continuation>
+	void Send(T value, Continuation&& continuation)
+	{
+		auto shared_continuation{ std::make_shared<std::decay_t<Continuation>>(std::forward<Continuation>(continuation)) };
+		auto const deliver{ [shared_continuation, &job_queue = job_queue](bool sent) {
+			job_queue.Add([shared_continuation, sent] { std::invoke(*shared_continuation, sent); });
+		} };
+
+		if (bool sent{}; !TrySend(value, sent, deliver))
+		{
+			deliver(sent);
+		}
+	}
+
+	template <std::invocable<std::optional<T>&&> Continuation>
+	void Receive(Continuation&& continuation)
+	{
+		auto shared_continuation{ std::make_shared<std::decay_t<Continuation>>(std::forward<Continuation>(continuation)) };
+		auto const deliver{ [shared_continuation, &job_queue = job_queue](std::optional<T>&& value) {
+			job_queue.Add([shared_continuation](std::optional<T> value) { std::invoke(*shared_continuation, std::move(value)); }, std::move(value));
+		} };
+
+		if (std::optional<T> value; !TryReceive(value, deliver))
+		{
+			deliver(std::move(value));
+		}
+	}
+
+	// Wakes every parked sender (with false) and receiver (with nothing); buffered values can still be received.
+	void Close()
+	{
+		std::unique_lock lk{ mutex };
+
+		closed = true;
+
+		auto parked_senders{ std::exchange(senders, {}) };
+		auto parked_receivers{ std::exchange(receivers, {}) };
+
+		lk.unlock();
+
+		for (auto& sender : parked_senders)
+		{
+			sender.deliver(false);
+		}
+
+		for (auto& receiver : parked_receivers)
+		{
+			receiver(std::nullopt);
+		}
+	}
+
+private:
+	struct ParkedSender
+	{
+		T value;
+		std::function<void(bool)> deliver;
+	};
+
+	AsyncJobQueue<>& job_queue;
+	std::size_t const capacity;
+	std::mutex mutex;
+	std::deque<T> buffer;
+	std::deque<ParkedSender> senders;
+	std::deque<std::function<void(std::optional<T>&&)>> receivers;
+	bool closed{};
+
+	// Either completes the send immediately, setting sent and returning false, or parks deliver and returns true.
+	template <typename Deliver>
+	bool TrySend(T& value, bool& sent, Deliver&& deliver)
+	{
+		std::unique_lock lk{ mutex };
+
+		if (closed)
+		{
+			sent = false;
+
+			return false;
+		}
+
+		if (!std::empty(receivers))
+		{
+			auto receiver{ std::move(receivers.front()) };
+
+			receivers.pop_front();
+
+			lk.unlock();
+
+			receiver(std::move(value));
+			sent = true;
+
+			return false;
+		}
+
+		if (std::size(buffer) < capacity)
+		{
+			buffer.push_back(std::move(value));
+			sent = true;
+
+			return false;
+		}
+
+		senders.push_back({ std::move(value), std::forward<Deliver>(deliver) });
+
+		return true;
+	}
+
+	// Either completes the receive immediately, setting value and returning false, or parks deliver and returns true.
+	template <typename Deliver>
+	bool TryReceive(std::optional<T>& value, Deliver&& deliver)
+	{
+		std::unique_lock lk{ mutex };
+
+		if (!std::empty(buffer) || !std::empty(senders))
+		{
+			std::function<void(bool)> sender_deliver;
+
+			if (!std::empty(buffer))
+			{
+				value = std::move(buffer.front());
+				buffer.pop_front();
+			}
+
+			// A parked sender either refills the buffer or, at capacity 0, hands its value over directly.
+			if (!std::empty(senders))
+			{
+				if (value)
+				{
+					buffer.push_back(std::move(senders.front().value));
+				}
+				else
+				{
+					value = std::move(senders.front().value);
+				}
+
+				sender_deliver = std::move(senders.front().deliver);
+				senders.pop_front();
+			}
+
+			lk.unlock();
+
+			if (sender_deliver)
+			{
+				sender_deliver(true);
+			}
+
+			return false;
+		}
+
+		if (closed)
+		{
+			return false;
+		}
+
+		receivers.push_back(std::forward<Deliver>(deliver));
+
+		return true;
+	}
+};
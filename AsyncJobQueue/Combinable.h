@@ -0,0 +1,79 @@
+#pragma once
+
+#include "AsyncJobQueue.h"
+
+#include <memory>
+
+// Thread-local accumulators for jobs of one queue: every worker owns a cache-line-aligned slot, so
+// accumulating never shares a cache line between cores; Combine folds the slots once at the end.
+// Threads that are not workers of the queue (e.g. a caller taking part in ParallelFor) get a slot
+// of their own through a mutex-protected lookup.
+template <typename T>
+class Combinable final
+{
+public:
+	explicit Combinable(AsyncJobQueue<>& job_queue, T const& identity = T{})
+		: job_queue{ job_queue }
+		, identity{ identity }
+		, worker_slots{ std::make_unique<Slot[]>(job_queue.GetNumberOfThreads()) }
+	{
+		for (std::size_t i{}; i < job_queue.GetNumberOfThreads(); ++i)
+		{
+			worker_slots[i].value = identity;
+		}
+	}
+
+	T& Local()
+	{
+		if (auto const index{ job_queue.GetWorkerIndex() }; index < job_queue.GetNumberOfThreads())
+		{
+			return worker_slots[index].value;
+		}
+
+		std::lock_guard lk{ mutex };
+
+		auto [it, inserted] { other_slot_map.try_emplace(std::this_thread::get_id(), identity) };
+
+		return it->second;
+	}
+
+	template <typename Reduce>
+	T Combine(Reduce&& reduce) const
+	{
+		auto result{ identity };
+
+		CombineEach([&result, &reduce](T const& value) {
+			result = std::invoke(reduce, std::move(result), value);
+		});
+
+		return result;
+	}
+
+	template <typename Func>
+	void CombineEach(Func&& func) const
+	{
+		for (std::size_t i{}; i < job_queue.GetNumberOfThreads(); ++i)
+		{
+			std::invoke(func, worker_slots[i].value);
+		}
+
+		std::lock_guard lk{ mutex };
+
+		for (auto const& [thread_id, value] : other_slot_map)
+		{
+			std::invoke(func, value);
+		}
+	}
+
+private:
+	struct alignas(cache_line_size) Slot
+	{
+		T value;
+	};
+
+	AsyncJobQueue<>& job_queue;
+	T identity;
+	std::unique_ptr<Slot[]> worker_slots;
+	mutable std::mutex mutex;
+	std::map<std::thread::id, T> other_slot_map;
+};
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// std::hash, made transparent for strings so they can be looked up by std::string_view or
+// const char* without constructing a temporary std::string.
+template <typename Key>
+struct KeyHash : std::hash<Key>
+{
+};
+
+template <>
+struct KeyHash<std::string>
+{
+	using is_transparent = void;
+
+	std::size_t operator()(std::string_view key) const noexcept
+	{
+		return std::hash<std::string_view>{}(key);
+	}
+};
+
+// Open-addressing hash map with linear probing, for small keys and values that are looked up,
+// inserted and erased at a high rate. Erasing leaves a tombstone rather than moving other entries,
+// so erasing never invalidates iterators to other entries; inserting may rehash and invalidate all.
+template <typename Key, typename Value, typename Hash = KeyHash<Key>, typename KeyEqual = std::equal_to<>>
+class FlatHashMap final
+{
+	struct Slot
+	{
+		std::optional<std::pair<Key, Value>> entry;
+		bool erased{};
+	};
+
+	template <bool Const>
+	class Iterator
+	{
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = std::pair<Key, Value>;
+		using difference_type = std::ptrdiff_t;
+		using pointer = std::conditional_t<Const, value_type const*, value_type*>;
+		using reference = std::conditional_t<Const, value_type const&, value_type&>;
+
+		Iterator() = default;
+
+		Iterator(std::conditional_t<Const, Slot const*, Slot*> slot, std::conditional_t<Const, Slot const*, Slot*> last)
+			: slot{ slot }
+			, last{ last }
+		{
+			SkipEmptySlots();
+		}
+
+		operator Iterator<true>() const
+			requires (!Const)
+		{
+			return { slot, last };
+		}
+
+		reference operator*() const
+		{
+			return *slot->entry;
+		}
+
+		pointer operator->() const
+		{
+			return &*slot->entry;
+		}
+
+		Iterator& operator++()
+		{
+			++slot;
+			SkipEmptySlots();
+
+			return *this;
+		}
+
+		Iterator operator++(int)
+		{
+			auto const it{ *this };
+
+			++*this;
+
+			return it;
+		}
+
+		bool operator==(Iterator const& other) const
+		{
+			return slot == other.slot;
+		}
+
+	private:
+		friend class FlatHashMap;
+
+		std::conditional_t<Const, Slot const*, Slot*> slot{};
+		std::conditional_t<Const, Slot const*, Slot*> last{};
+
+		void SkipEmptySlots()
+		{
+			while (slot != last && !slot->entry)
+			{
+				++slot;
+			}
+		}
+	};
+
+	// Keys of other types are looked up without conversion when Hash and KeyEqual are transparent.
+	template <typename K>
+	static constexpr bool Lookup = !std::is_convertible_v<K const&, Iterator<true>>
+		&& (std::is_convertible_v<K const&, Key> || requires { typename Hash::is_transparent; typename KeyEqual::is_transparent; });
+
+public:
+	using key_type = Key;
+	using mapped_type = Value;
+	using value_type = std::pair<Key, Value>;
+	using iterator = Iterator<false>;
+	using const_iterator = Iterator<true>;
+
+	iterator begin()
+	{
+		return { std::data(slots), std::data(slots) + std::size(slots) };
+	}
+
+	iterator end()
+	{
+		return { std::data(slots) + std::size(slots), std::data(slots) + std::size(slots) };
+	}
+
+	const_iterator begin() const
+	{
+		return { std::data(slots), std::data(slots) + std::size(slots) };
+	}
+
+	const_iterator end() const
+	{
+		return { std::data(slots) + std::size(slots), std::data(slots) + std::size(slots) };
+	}
+
+	bool empty() const
+	{
+		return number_of_entries == 0;
+	}
+
+	std::size_t size() const
+	{
+		return number_of_entries;
+	}
+
+	void clear()
+	{
+		slots.clear();
+		number_of_entries = 0;
+		number_of_erased_slots = 0;
+		shift = 64;
+	}
+
+	template <typename K>
+		requires Lookup<K>
+	iterator find(K const& key)
+	{
+		auto const index{ FindIndex(key) };
+
+		return index ? Iterator<false>{ &slots[*index], std::data(slots) + std::size(slots) } : end();
+	}
+
+	template <typename K>
+		requires Lookup<K>
+	const_iterator find(K const& key) const
+	{
+		auto const index{ FindIndex(key) };
+
+		return index ? Iterator<true>{ &slots[*index], std::data(slots) + std::size(slots) } : end();
+	}
+
+	template <typename K>
+		requires Lookup<K>
+	bool contains(K const& key) const
+	{
+		return FindIndex(key).has_value();
+	}
+
+	Value& operator[](Key const& key)
+	{
+		return try_emplace(key).first->second;
+	}
+
+	template <typename... Ts>
+	std::pair<iterator, bool> try_emplace(Key const& key, Ts&&... ts)
+	{
+		if (auto const index{ FindIndex(key) })
+		{
+			return { { &slots[*index], std::data(slots) + std::size(slots) }, false };
+		}
+
+		if ((number_of_entries + number_of_erased_slots + 1) * 4 > std::size(slots) * 3)
+		{
+			Rehash();
+		}
+
+		auto index{ HomeIndex(key) };
+
+		// The key is absent, so the first free slot on its probe sequence is as good as any.
+		while (slots[index].entry)
+		{
+			index = (index + 1) & (std::size(slots) - 1);
+		}
+
+		auto& slot{ slots[index] };
+
+		number_of_erased_slots -= slot.erased;
+		slot.erased = false;
+		slot.entry.emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Ts>(ts)...));
+		++number_of_entries;
+
+		return { { &slot, std::data(slots) + std::size(slots) }, true };
+	}
+
+	template <typename V>
+	std::pair<iterator, bool> emplace(Key const& key, V&& value)
+	{
+		return try_emplace(key, std::forward<V>(value));
+	}
+
+	// Returns the iterator following it.
+	iterator erase(const_iterator it)
+	{
+		auto const index{ static_cast<std::size_t>(it.slot - std::data(slots)) };
+
+		EraseAt(index);
+
+		return { &slots[index], std::data(slots) + std::size(slots) };
+	}
+
+	iterator erase(iterator it)
+	{
+		return erase(const_iterator{ it });
+	}
+
+	template <typename K>
+		requires Lookup<K>
+	std::size_t erase(K const& key)
+	{
+		if (auto const index{ FindIndex(key) })
+		{
+			EraseAt(*index);
+
+			return 1;
+		}
+
+		return 0;
+	}
+
+private:
+	std::vector<Slot> slots;
+	std::size_t number_of_entries{};
+	std::size_t number_of_erased_slots{};
+	// 64 - log2(std::size(slots)), for Fibonacci hashing
+	int shift{ 64 };
+
+	template <typename K>
+	std::size_t HomeIndex(K const& key) const
+	{
+		// Spreads hashes that differ only in their high bits (or, for std::hash of integers, only
+		// in their low ones) over the whole table.
+		return static_cast<std::size_t>((static_cast<std::uint64_t>(Hash{}(key)) * 0x9E3779B97F4A7C15ull) >> shift);
+	}
+
+	template <typename K>
+	std::optional<std::size_t> FindIndex(K const& key) const
+	{
+		if (number_of_entries == 0)
+		{
+			return std::nullopt;
+		}
+
+		for (auto index{ HomeIndex(key) }; ; index = (index + 1) & (std::size(slots) - 1))
+		{
+			auto const& slot{ slots[index] };
+
+			if (slot.entry)
+			{
+				if (KeyEqual{}(slot.entry->first, key))
+				{
+					return index;
+				}
+			}
+			else if (!slot.erased)
+			{
+				return std::nullopt;
+			}
+		}
+	}
+
+	void EraseAt(std::size_t index)
+	{
+		slots[index].entry.reset();
+		slots[index].erased = true;
+		++number_of_erased_slots;
+		--number_of_entries;
+
+		// A tombstone followed by a never-used slot ends no probe sequence that reaches past it,
+		// so such tombstones can be reclaimed. Entries never move, keeping iterators valid.
+		auto const mask{ std::size(slots) - 1 };
+
+		while (slots[index].erased && !slots[(index + 1) & mask].entry && !slots[(index + 1) & mask].erased)
+		{
+			slots[index].erased = false;
+			--number_of_erased_slots;
+			index = (index - 1) & mask;
+		}
+	}
+
+	// Doubles the table unless tombstones make up much of it, in which case they are just dropped.
+	void Rehash()
+	{
+		auto const capacity{ std::max<std::size_t>(std::bit_ceil((number_of_entries + 1) * 2), 16) };
+		auto old_slots{ std::exchange(slots, std::vector<Slot>(capacity)) };
+
+		shift = 64 - std::countr_zero(capacity);
+		number_of_erased_slots = 0;
+
+		for (auto& slot : old_slots)
+		{
+			if (slot.entry)
+			{
+				auto index{ HomeIndex(slot.entry->first) };
+
+				while (slots[index].entry)
+				{
+					index = (index + 1) & (capacity - 1);
+				}
+
+				slots[index].entry.emplace(std::move(*slot.entry));
+			}
+		}
+	}
+};
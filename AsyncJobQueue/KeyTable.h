@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <type_traits>
+#include <vector>
+
+// Interns keys: threads asking for equal keys get the same Value, so a key is copied into the table
+// once rather than into every structure that refers to it. Value is constructed from the key and keeps
+// it as a key member. An entry lives as long as a std::shared_ptr to its Value, which may outlive
+// the table. Lookups of existing keys only take a shared lock.
+template <typename Key, typename Value, typename KeyPolicy>
+class KeyTable final : public std::enable_shared_from_this<KeyTable<Key, Value, KeyPolicy>>
+{
+public:
+	// Keeps the entry alive
+	using Handle = std::shared_ptr<Value>;
+
+	// A key of another type than Key is only converted to Key if it is not interned yet.
+	template <typename K>
+	std::shared_ptr<Value> Intern(K const& key)
+	{
+		if (auto value{ Find(key) })
+		{
+			return value;
+		}
+
+		std::unique_lock lk{ mutex };
+
+		auto const it{ map.try_emplace(Key{ key }).first };
+		auto& weak_value{ it->second };
+
+		if (auto value{ weak_value.lock() })
+		{
+			return value;
+		}
+
+		std::shared_ptr<Value> value{ new Value{ it->first }, [table = this->weak_from_this()](Value* value) {
+			if (auto const locked_table{ table.lock() })
+			{
+				locked_table->Erase(value->key);
+			}
+
+			delete value;
+		} };
+
+		weak_value = value;
+
+		return value;
+	}
+
+	// Returns nullptr if key is not interned.
+	template <typename K>
+	std::shared_ptr<Value> Find(K const& key) const
+	{
+		std::shared_lock lk{ mutex };
+
+		if (auto it{ map.find(key) }; it != std::end(map))
+		{
+			return it->second.lock();
+		}
+
+		return nullptr;
+	}
+
+	std::vector<std::shared_ptr<Value>> GetValues() const
+	{
+		std::vector<std::shared_ptr<Value>> values;
+
+		std::shared_lock lk{ mutex };
+
+		values.reserve(std::size(map));
+
+		for (auto const& [key, weak_value] : map)
+		{
+			if (auto value{ weak_value.lock() })
+			{
+				values.push_back(std::move(value));
+			}
+		}
+
+		return values;
+	}
+
+private:
+	mutable std::shared_mutex mutex;
+	typename KeyPolicy::template Map<Key, std::weak_ptr<Value>> map;
+
+	// The key may have been interned again between the last reference going away and this call.
+	void Erase(Key const& key)
+	{
+		std::lock_guard lk{ mutex };
+
+		if (auto it{ map.find(key) }; it != std::end(map) && it->second.expired())
+		{
+			map.erase(it);
+		}
+	}
+};
+
+// KeyTable for keys that are small non-negative integers or enumerators, all below size: the values
+// live in one array for the table's lifetime, so interning is an index and allocates nothing, and
+// handles are plain pointers, with no reference count for every lookup to update.
+template <typename Key, typename Value, std::size_t size>
+class DenseKeyTable final
+{
+public:
+	// Valid while the table exists
+	using Handle = Value*;
+
+	DenseKeyTable()
+	{
+		for (std::size_t i{}; i < size; ++i)
+		{
+			(*values)[i].key = static_cast<Key>(i);
+		}
+	}
+
+	// Returns nullptr if key does not lie below size.
+	Value* Intern(Key const& key)
+	{
+		return Find(key);
+	}
+
+	// Returns nullptr if key does not lie below size.
+	Value* Find(Key const& key) const
+	{
+		if (auto const index{ ToIndex(key) }; index < size)
+		{
+			return &(*values)[index];
+		}
+
+		return nullptr;
+	}
+
+	std::vector<Value*> GetValues() const
+	{
+		std::vector<Value*> all_values;
+
+		all_values.reserve(size);
+
+		for (auto& value : *values)
+		{
+			all_values.push_back(&value);
+		}
+
+		return all_values;
+	}
+
+private:
+	std::unique_ptr<std::array<Value, size>> const values{ std::make_unique<std::array<Value, size>>() };
+
+	static std::size_t ToIndex(Key key)
+	{
+		if constexpr (std::is_enum_v<Key>)
+		{
+			// Negative values wrap around to indexes above size.
+			return static_cast<std::size_t>(static_cast<std::make_unsigned_t<std::underlying_type_t<Key>>>(key));
+		}
+		else
+		{
+			return static_cast<std::size_t>(key);
+		}
+	}
+};
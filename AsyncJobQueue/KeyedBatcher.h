@@ -0,0 +1,169 @@
+#pragma once
+
+#include "AsyncJobQueue.h"
+
+#include <span>
+
+// Collects payloads per key and hands them to the key's handler in batches, each batch running as
+// one job of that key on the queue, so Join(key) also waits for payloads not yet delivered.
+// Batches of a key are delivered one at a time and in the order the payloads were added.
+// Any keyed queue with a matching Key can be used, whatever its key and queue policies. The batcher
+// must outlive the drain jobs it has queued, e.g. by joining their keys before it is destroyed.
+template <typename Key, typename Payload>
+class KeyedBatcher final
+{
+public:
+	using Handler = std::function<void(std::span<Payload>)>;
+
+	template <typename KeyPolicy, typename QueuePolicy>
+	explicit KeyedBatcher(AsyncJobQueue<Key, KeyPolicy, QueuePolicy>& job_queue)
+		: add_drain_job{ [this, &job_queue](Key const& key, std::chrono::steady_clock::duration delay) {
+			if (delay == std::chrono::steady_clock::duration::zero())
+			{
+				job_queue.Add(key, [this, key] { DrainBatch(key, true); });
+			}
+			else
+			{
+				job_queue.AddDelayed(key, delay, [this, key] { DrainBatch(key, false); });
+			}
+		} }
+	{
+	}
+
+	// A batch is dispatched once it holds max_batch_size payloads or its oldest payload has waited max_wait.
+	void Register(Key const& key, Handler handler, std::size_t max_batch_size, std::chrono::steady_clock::duration max_wait = {})
+	{
+		std::lock_guard lk{ mutex };
+
+		auto& batch{ batch_map[key] };
+
+		batch.handler = std::move(handler);
+		batch.max_batch_size = std::max<std::size_t>(max_batch_size, 1);
+		batch.max_wait = max_wait;
+	}
+
+	// key must have been registered.
+	void Add(Key const& key, Payload payload)
+	{
+		std::unique_lock lk{ mutex };
+
+		auto& batch{ batch_map.at(key) };
+
+		if (std::empty(batch.payloads))
+		{
+			batch.first_payload_time = std::chrono::steady_clock::now();
+		}
+
+		batch.payloads.push_back(std::move(payload));
+
+		auto const delay{ ScheduleDrain(batch) };
+
+		lk.unlock();
+
+		QueueDrain(key, delay);
+	}
+
+private:
+	struct Batch
+	{
+		Handler handler;
+		std::size_t max_batch_size{};
+		std::chrono::steady_clock::duration max_wait{};
+		std::vector<Payload> payloads;
+		std::chrono::steady_clock::time_point first_payload_time;
+		bool immediate_drain_queued{};
+		bool delayed_drain_queued{};
+		bool draining{};
+	};
+
+	// Adds a DrainBatch job for a key to the queue the batcher was constructed with; a zero delay runs it as soon as possible.
+	std::function<void(Key const&, std::chrono::steady_clock::duration)> const add_drain_job;
+	std::mutex mutex;
+	std::map<Key, Batch> batch_map;
+
+	// Returns the delay of the drain job to queue for batch, if one is needed (zero to run it as soon as possible).
+	// The caller queues it after releasing mutex.
+	std::optional<std::chrono::steady_clock::duration> ScheduleDrain(Batch& batch)
+	{
+		if (batch.immediate_drain_queued || std::empty(batch.payloads))
+		{
+			return std::nullopt;
+		}
+
+		auto const waited{ std::chrono::steady_clock::now() - batch.first_payload_time };
+
+		if (std::size(batch.payloads) >= batch.max_batch_size || waited >= batch.max_wait)
+		{
+			batch.immediate_drain_queued = true;
+
+			return std::chrono::steady_clock::duration::zero();
+		}
+
+		if (!batch.delayed_drain_queued)
+		{
+			batch.delayed_drain_queued = true;
+
+			return batch.max_wait - waited;
+		}
+
+		return std::nullopt;
+	}
+
+	void QueueDrain(Key const& key, std::optional<std::chrono::steady_clock::duration> delay)
+	{
+		if (!delay)
+		{
+			return;
+		}
+
+		add_drain_job(key, *delay);
+	}
+
+	void DrainBatch(Key const& key, bool immediate)
+	{
+		std::unique_lock lk{ mutex };
+
+		auto& batch{ batch_map.at(key) };
+
+		(immediate ? batch.immediate_drain_queued : batch.delayed_drain_queued) = false;
+
+		// A drain already in progress reschedules itself for whatever is left when it finishes.
+		if (batch.draining || std::empty(batch.payloads))
+		{
+			return;
+		}
+
+		std::vector<Payload> payloads;
+
+		if (std::size(batch.payloads) <= batch.max_batch_size)
+		{
+			payloads.swap(batch.payloads);
+		}
+		else
+		{
+			auto const last{ std::begin(batch.payloads) + batch.max_batch_size };
+
+			payloads.assign(std::make_move_iterator(std::begin(batch.payloads)), std::make_move_iterator(last));
+			batch.payloads.erase(std::begin(batch.payloads), last);
+		}
+
+		batch.draining = true;
+
+		// Copied, since Register may replace the batch's handler while the lock is released.
+		auto const handler{ batch.handler };
+
+		lk.unlock();
+
+		handler(payloads);
+
+		lk.lock();
+
+		batch.draining = false;
+
+		auto const delay{ ScheduleDrain(batch) };
+
+		lk.unlock();
+
+		QueueDrain(key, delay);
+	}
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "AsyncJobQueue.h"
+
+// Runs jobs on an AsyncJobQueue<> and passes their results to a consumer strictly in submission order.
+// Completed results are published without locking into a ring of capacity slots. The job that completes
+// the oldest outstanding result hands it and every consecutive ready result to the consumer, so the
+// consumer is never called concurrently. Add blocks while the oldest outstanding result is capacity
+// submissions behind, so a slow head applies backpressure instead of growing the buffer. As that wait
+// relies on the workers, Add should not be called from a job of the same queue.
+template <typename Result>
+class OrderedResults final
+{
+public:
+	template <typename Consumer>
+	requires std::invocable<Consumer&, Result&&>
+	OrderedResults(AsyncJobQueue<>& job_queue, std::size_t capacity, Consumer&& consumer)
+		: job_queue{ job_queue }
+		, state{ std::make_shared<State>(std::max<std::size_t>(capacity, 1), std::forward<Consumer>(consumer)) }
+	{
+	}
+
+	~OrderedResults()
+	{
+		Join();
+	}
+
+	OrderedResults(OrderedResults const&) = delete;
+	OrderedResults& operator=(OrderedResults const&) = delete;
+
+	template <typename Func, typename... Ts>
+	requires std::is_same_v<std::invoke_result_t<Func, Ts...>, Result>
+	void Add(Func&& func, Ts&&... ts)
+	{
+		auto const sequence{ state->next_sequence++ };
+
+		for (auto head{ state->head.load() }; sequence - head >= state->capacity; head = state->head.load())
+		{
+			state->head.wait(head);
+		}
+
+		job_queue.Add([state = state, sequence](std::decay_t<Func> func, std::decay_t<Ts>... ts) {
+			state->Publish(sequence, std::invoke(std::move(func), std::move(ts)...));
+		}, std::forward<Func>(func), std::forward<Ts>(ts)...);
+	}
+
+	// Returns once the results of all jobs added so far have been consumed.
+	void Join()
+	{
+		for (auto head{ state->head.load() }; head != state->next_sequence; head = state->head.load())
+		{
+			state->head.wait(head);
+		}
+	}
+
+private:
+	struct alignas(cache_line_size) Slot
+	{
+		// sequence + 1 of the result stored in the slot; results of older laps never match the head
+		std::atomic_size_t ready_sequence{};
+		std::optional<Result> result;
+	};
+
+	// Shared with the jobs, as a job may still be leaving Drain after Join has seen its result consumed.
+	struct State
+	{
+		template <typename Consumer>
+		State(std::size_t capacity, Consumer&& consumer)
+			: capacity{ capacity }
+			, slots{ std::make_unique<Slot[]>(capacity) }
+			, consumer{ std::forward<Consumer>(consumer) }
+		{
+		}
+
+		std::size_t const capacity;
+		std::unique_ptr<Slot[]> const slots;
+		std::function<void(Result&&)> const consumer;
+		std::atomic_size_t next_sequence{};
+		alignas(cache_line_size) std::atomic_size_t head{};
+		std::atomic_bool draining{};
+
+		void Publish(std::size_t sequence, Result&& result)
+		{
+			auto& slot{ slots[sequence % capacity] };
+
+			slot.result.emplace(std::move(result));
+			slot.ready_sequence.store(sequence + 1);
+
+			Drain();
+		}
+
+		// A publisher that fails to become the drainer relies on the current drainer to see its result;
+		// the drainer therefore checks the head once more after letting go, which the sequentially
+		// consistent store and exchange make sure cannot both miss.
+		void Drain()
+		{
+			while (!draining.exchange(true))
+			{
+				auto head_sequence{ head.load(std::memory_order_relaxed) };
+
+				for (; slots[head_sequence % capacity].ready_sequence.load() == head_sequence + 1; )
+				{
+					auto& slot{ slots[head_sequence % capacity] };
+
+					consumer(std::move(*slot.result));
+					slot.result.reset();
+
+					head.store(++head_sequence);
+					head.notify_all();
+				}
+
+				draining.store(false);
+
+				if (slots[head_sequence % capacity].ready_sequence.load() != head_sequence + 1)
+				{
+					return;
+				}
+			}
+		}
+	};
+
+	AsyncJobQueue<>& job_queue;
+	std::shared_ptr<State> const state;
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <tuple>
+
+// Inputs are processed in tiles of about this many bytes, small enough to stay in a core's L2 cache
+// between the passes that scan and copy algorithms make over each tile.
+inline constexpr std::size_t cache_tile_size{ 256 * 1024 };
+
+template <std::ranges::random_access_range Range, std::random_access_iterator OutIt, typename Func>
+requires std::invocable<Func&, std::ranges::range_reference_t<Range>>
+OutIt Transform(AsyncJobQueue<>& job_queue, Range&& range, OutIt out, Func&& func)
+{
+	using Difference = std::ranges::range_difference_t<Range>;
+
+	auto const first{ std::ranges::begin(range) };
+	auto const size{ std::ranges::distance(range) };
+	auto const tile{ static_cast<Difference>(std::max<std::size_t>(cache_tile_size / sizeof(std::ranges::range_value_t<Range>), 1)) };
+
+	ParallelForChunks(job_queue, Difference{}, size, [&func, first, out](Difference begin, Difference end) {
+		std::transform(first + begin, first + end, out + begin, std::ref(func));
+	}, std::min(tile, std::max<Difference>(size / static_cast<Difference>((job_queue.GetNumberOfThreads() + 1) * 4), 1)));
+
+	return out + size;
+}
+
+// Scans one round of tiles at a time: every tile is reduced in parallel, the tile totals are scanned
+// sequentially, and every tile is then scanned in parallel starting from its carry-in, while it is
+// still likely to be in cache.
+template <std::ranges::random_access_range Range, std::random_access_iterator OutIt, typename BinaryOp = std::plus<>>
+OutIt InclusiveScan(AsyncJobQueue<>& job_queue, Range&& range, OutIt out, BinaryOp op = {})
+{
+	using Difference = std::ranges::range_difference_t<Range>;
+	using T = std::ranges::range_value_t<Range>;
+
+	auto const first{ std::ranges::begin(range) };
+	auto const size{ std::ranges::distance(range) };
+	auto const number_of_tiles_per_round{ static_cast<Difference>(job_queue.GetNumberOfThreads() + 1) };
+	auto const tile{ std::min(static_cast<Difference>(std::max<std::size_t>(cache_tile_size / sizeof(T), 1)),
+		std::max<Difference>(size / number_of_tiles_per_round, 1)) };
+
+	std::vector<std::optional<T>> tile_totals(static_cast<std::size_t>(number_of_tiles_per_round));
+	std::optional<T> carry;
+
+	for (Difference round_begin{}; round_begin < size; round_begin += tile * number_of_tiles_per_round)
+	{
+		auto const round_tiles{ std::min(number_of_tiles_per_round, (size - round_begin + tile - 1) / tile) };
+		auto const tile_range{ [&](Difference i) {
+			auto const begin{ round_begin + i * tile };
+
+			return std::pair{ begin, std::min(begin + tile, size) };
+		} };
+
+		ParallelFor(job_queue, Difference{ 1 }, round_tiles, [&](Difference i) {
+			auto const [begin, end] { tile_range(i) };
+
+			// Folded left to right, as op need only be associative, not commutative.
+			tile_totals[static_cast<std::size_t>(i)] = std::accumulate(first + begin + 1, first + end, T{ first[begin] }, op);
+		});
+
+		// Tile 0 of the round is scanned directly from the carry while the other tiles wait for theirs.
+		auto const [begin, end] { tile_range(0) };
+
+		if (carry)
+		{
+			std::inclusive_scan(first + begin, first + end, out + begin, op, *carry);
+		}
+		else
+		{
+			std::inclusive_scan(first + begin, first + end, out + begin, op);
+		}
+
+		carry = out[end - 1];
+
+		std::vector<T> carries;
+
+		carries.reserve(static_cast<std::size_t>(round_tiles));
+
+		for (Difference i{ 1 }; i < round_tiles; ++i)
+		{
+			carries.push_back(*carry);
+			carry = std::invoke(op, std::move(*carry), *tile_totals[static_cast<std::size_t>(i)]);
+		}
+
+		ParallelFor(job_queue, Difference{ 1 }, round_tiles, [&](Difference i) {
+			auto const [begin, end] { tile_range(i) };
+
+			std::inclusive_scan(first + begin, first + end, out + begin, op, carries[static_cast<std::size_t>(i - 1)]);
+		});
+	}
+
+	return out + size;
+}
+
+// Counts the matches of every tile in parallel, turns the counts into output offsets and then
+// copies every tile in parallel. Returns the end of the copied elements.
+template <std::ranges::random_access_range Range, std::random_access_iterator OutIt, typename Predicate>
+requires std::predicate<Predicate&, std::ranges::range_reference_t<Range>>
+OutIt CopyIf(AsyncJobQueue<>& job_queue, Range&& range, OutIt out, Predicate&& predicate)
+{
+	using Difference = std::ranges::range_difference_t<Range>;
+
+	auto const first{ std::ranges::begin(range) };
+	auto const size{ std::ranges::distance(range) };
+	auto const tile{ std::min(static_cast<Difference>(std::max<std::size_t>(cache_tile_size / sizeof(std::ranges::range_value_t<Range>), 1)),
+		std::max<Difference>(size / static_cast<Difference>((job_queue.GetNumberOfThreads() + 1) * 4), 1)) };
+	auto const number_of_tiles{ (size + tile - 1) / tile };
+
+	std::vector<Difference> offsets(static_cast<std::size_t>(number_of_tiles) + 1);
+
+	ParallelFor(job_queue, Difference{}, number_of_tiles, [&](Difference i) {
+		offsets[static_cast<std::size_t>(i) + 1] = std::count_if(first + i * tile, first + std::min((i + 1) * tile, size), std::ref(predicate));
+	});
+
+	std::inclusive_scan(std::begin(offsets), std::end(offsets), std::begin(offsets));
+
+	ParallelFor(job_queue, Difference{}, number_of_tiles, [&](Difference i) {
+		std::copy_if(first + i * tile, first + std::min((i + 1) * tile, size), out + offsets[static_cast<std::size_t>(i)], std::ref(predicate));
+	});
+
+	return out + offsets.back();
+}
+
+// Merge sort: cache-sized runs are sorted in parallel, then merged pairwise level by level. Every
+// merge of a level is cut into equal parts at merge-path split points, so the last levels, with only
+// one or two merges, still keep every participant busy. A level finds all its split points before it
+// moves any element, as the search for one part's split reads elements of the neighbouring parts. Like std::sort it is not stable, and it needs
+// a temporary buffer the size of the input.
+template <std::ranges::random_access_range Range, typename Compare = std::ranges::less>
+void Sort(AsyncJobQueue<>& job_queue, Range&& range, Compare comp = {})
+{
+	using Difference = std::ranges::range_difference_t<Range>;
+	using T = std::ranges::range_value_t<Range>;
+
+	auto const first{ std::ranges::begin(range) };
+	auto const size{ std::ranges::distance(range) };
+	auto const number_of_participants{ static_cast<Difference>(job_queue.GetNumberOfThreads() + 1) };
+	auto const run{ std::max(static_cast<Difference>(std::max<std::size_t>(cache_tile_size / sizeof(T), 1)), (size + number_of_participants * 4 - 1) / (number_of_participants * 4)) };
+
+	if (size <= run)
+	{
+		std::sort(first, first + size, std::ref(comp));
+
+		return;
+	}
+
+	auto const number_of_runs{ (size + run - 1) / run };
+
+	ParallelFor(job_queue, Difference{}, number_of_runs, [&](Difference i) {
+		std::sort(first + i * run, first + std::min((i + 1) * run, size), std::ref(comp));
+	});
+
+	std::vector<T> buffer(static_cast<std::size_t>(size));
+	auto in_buffer{ false };
+
+	// Number of elements of the stable merge of a and b that come from a among the first k.
+	auto const merge_path{ [&comp](auto a, Difference m, auto b, Difference n, Difference k) {
+		auto low{ std::max<Difference>(k - n, 0) };
+		auto high{ std::min(k, m) };
+
+		while (low < high)
+		{
+			auto const i{ low + (high - low) / 2 };
+
+			if (!std::invoke(comp, b[k - i - 1], a[i]))
+			{
+				low = i + 1;
+			}
+			else
+			{
+				high = i;
+			}
+		}
+
+		return low;
+	} };
+
+	auto const merge_level{ [&](auto source, auto destination, Difference width) {
+		auto const parts_per_merge{ std::max<Difference>(number_of_participants * 2 / ((size + 2 * width - 1) / (2 * width)), 1) };
+		auto const number_of_merges{ (size + 2 * width - 1) / (2 * width) };
+		auto const part_range{ [&](Difference task) {
+			auto const merge_begin{ task / parts_per_merge * 2 * width };
+			auto const part{ task % parts_per_merge };
+			auto const m{ std::min(width, size - merge_begin) };
+			auto const n{ std::min(width, size - merge_begin - m) };
+
+			return std::tuple{ merge_begin, m, n, (m + n) * part / parts_per_merge, (m + n) * (part + 1) / parts_per_merge };
+		} };
+
+		// Split point of the start of every part
+		std::vector<Difference> splits(static_cast<std::size_t>(number_of_merges * parts_per_merge));
+
+		ParallelFor(job_queue, Difference{}, number_of_merges * parts_per_merge, [&](Difference task) {
+			auto const [merge_begin, m, n, k_begin, k_end] { part_range(task) };
+			auto const a{ source + merge_begin };
+
+			splits[static_cast<std::size_t>(task)] = merge_path(a, m, a + m, n, k_begin);
+		});
+
+		ParallelFor(job_queue, Difference{}, number_of_merges * parts_per_merge, [&](Difference task) {
+			auto const [merge_begin, m, n, k_begin, k_end] { part_range(task) };
+			auto const a{ source + merge_begin };
+			auto const b{ a + m };
+			auto const i_begin{ splits[static_cast<std::size_t>(task)] };
+			// The last part of a merge ends at the end of both runs.
+			auto const i_end{ (task + 1) % parts_per_merge != 0 ? splits[static_cast<std::size_t>(task + 1)] : m };
+
+			std::merge(std::make_move_iterator(a + i_begin), std::make_move_iterator(a + i_end),
+				std::make_move_iterator(b + (k_begin - i_begin)), std::make_move_iterator(b + (k_end - i_end)),
+				destination + merge_begin + k_begin, std::ref(comp));
+		});
+	} };
+
+	for (auto width{ run }; width < size; width *= 2)
+	{
+		if (in_buffer)
+		{
+			merge_level(std::begin(buffer), first, width);
+		}
+		else
+		{
+			merge_level(first, std::begin(buffer), width);
+		}
+
+		in_buffer = !in_buffer;
+	}
+
+	if (in_buffer)
+	{
+		Transform(job_queue, buffer, first, [](T& value) -> T&& { return std::move(value); });
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "AsyncJobQueue.h"
+
+#include <atomic>
+#include <iterator>
+
+// Runs func(first, last) over chunks covering [begin, end) on the queue's workers and the calling thread.
+// Chunks are claimed from a shared counter with one compare-and-swap each and shrink as the range
+// drains (guided self-scheduling), so uneven iteration costs still balance out; min_grain bounds the
+// smallest chunk. Returns once every chunk has finished.
+template <std::integral Index, typename Func>
+requires std::invocable<Func&, Index, Index>
+void ParallelForChunks(AsyncJobQueue<>& job_queue, Index begin, Index end, Func&& func, Index min_grain = 1)
+{
+	if (!(begin < end))
+	{
+		return;
+	}
+
+	// Helper jobs may start after ParallelForChunks has returned; they only touch the shared state then,
+	// never func, as by that time no chunk is left to claim.
+	struct State
+	{
+		std::atomic<Index> next;
+		Index end;
+		Index min_grain;
+		Index divisor;
+		std::remove_reference_t<Func>* func;
+		std::atomic<std::size_t> number_of_helpers;
+	};
+
+	auto const number_of_participants{ job_queue.GetNumberOfThreads() + 1 };
+	auto const state{ std::make_shared<State>(begin, end, std::max<Index>(min_grain, 1), static_cast<Index>(number_of_participants * 2), &func, 0) };
+
+	auto const run_chunks{ [](State& state) {
+		auto first{ state.next.load() };
+
+		while (first < state.end)
+		{
+			auto const remaining{ static_cast<Index>(state.end - first) };
+			auto const chunk{ std::min(remaining, std::max(state.min_grain, static_cast<Index>(remaining / state.divisor))) };
+
+			if (state.next.compare_exchange_weak(first, static_cast<Index>(first + chunk)))
+			{
+				std::invoke(*state.func, first, static_cast<Index>(first + chunk));
+
+				first = state.next.load();
+			}
+		}
+	} };
+
+	auto const number_of_chunks{ static_cast<std::size_t>((end - begin) / state->min_grain) };
+
+	for (std::size_t i{}; i < std::min(job_queue.GetNumberOfThreads(), number_of_chunks); ++i)
+	{
+		job_queue.Add([state, run_chunks] {
+			++state->number_of_helpers;
+
+			run_chunks(*state);
+
+			if (--state->number_of_helpers == 0)
+			{
+				state->number_of_helpers.notify_all();
+			}
+		});
+	}
+
+	run_chunks(*state);
+
+	for (auto n{ state->number_of_helpers.load() }; n != 0; n = state->number_of_helpers.load())
+	{
+		state->number_of_helpers.wait(n);
+	}
+}
+
+// Runs func(i) for every i in [begin, end); see ParallelForChunks.
+template <std::integral Index, typename Func>
+requires std::invocable<Func&, Index>
+void ParallelFor(AsyncJobQueue<>& job_queue, Index begin, Index end, Func&& func, Index min_grain = 1)
+{
+	ParallelForChunks(job_queue, begin, end, [&func](Index first, Index last) {
+		for (auto i{ first }; i < last; ++i)
+		{
+			std::invoke(func, i);
+		}
+	}, min_grain);
+}
+
+template <std::ranges::random_access_range Range, typename Func>
+requires std::invocable<Func&, std::ranges::range_reference_t<Range>>
+void ParallelForEach(AsyncJobQueue<>& job_queue, Range&& range, Func&& func, std::ranges::range_difference_t<Range> min_grain = 1)
+{
+	auto const first{ std::ranges::begin(range) };
+
+	ParallelFor(job_queue, std::ranges::range_difference_t<Range>{}, std::ranges::distance(range), [&func, first](auto i) {
+		std::invoke(func, first[i]);
+	}, min_grain);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Combinable.h"
+#include "ParallelFor.h"
+
+#include <optional>
+
+// Folds reduce(accumulator, func(i)) over [begin, end) into per-worker accumulators that are
+// combined once at the end; reduce must be associative and commutative, identity its neutral element.
+template <std::integral Index, typename T, typename Func, typename Reduce>
+requires std::invocable<Func&, Index>
+T ParallelReduce(AsyncJobQueue<>& job_queue, Index begin, Index end, T identity, Func&& func, Reduce&& reduce, Index min_grain = 1)
+{
+	Combinable<T> combinable{ job_queue, identity };
+
+	ParallelForChunks(job_queue, begin, end, [&](Index first, Index last) {
+		auto& local{ combinable.Local() };
+
+		for (auto i{ first }; i < last; ++i)
+		{
+			local = std::invoke(reduce, std::move(local), std::invoke(func, i));
+		}
+	}, min_grain);
+
+	return combinable.Combine(reduce);
+}
+
+// Parallel std::transform_reduce: reduce(init, transform(x)...) over every x in range. Needs no neutral
+// element: each chunk starts from its first value, and init enters the result exactly once.
+template <std::ranges::random_access_range Range, typename T, typename Reduce, typename Transform>
+requires std::invocable<Transform&, std::ranges::range_reference_t<Range>>
+T TransformReduce(AsyncJobQueue<>& job_queue, Range&& range, T init, Reduce&& reduce, Transform&& transform)
+{
+	auto const first{ std::ranges::begin(range) };
+	auto const size{ std::ranges::distance(range) };
+
+	// Keep chunks large enough that one Local() lookup per chunk is negligible.
+	auto const min_grain{ std::max<std::ranges::range_difference_t<Range>>(size / static_cast<std::ranges::range_difference_t<Range>>((job_queue.GetNumberOfThreads() + 1) * 64), 1) };
+
+	Combinable<std::optional<T>> combinable{ job_queue };
+
+	ParallelForChunks(job_queue, std::ranges::range_difference_t<Range>{}, size, [&](auto first_index, auto last_index) {
+		T value(std::invoke(transform, first[first_index]));
+
+		for (auto i{ first_index + 1 }; i < last_index; ++i)
+		{
+			value = std::invoke(reduce, std::move(value), std::invoke(transform, first[i]));
+		}
+
+		auto& local{ combinable.Local() };
+
+		local = local ? std::invoke(reduce, std::move(*local), std::move(value)) : std::move(value);
+	}, min_grain);
+
+	combinable.CombineEach([&init, &reduce](std::optional<T> const& value) {
+		if (value)
+		{
+			init = std::invoke(reduce, std::move(init), *value);
+		}
+	});
+
+	return init;
+}
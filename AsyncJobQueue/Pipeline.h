@@ -0,0 +1,251 @@
+#pragma once
+
+#include "TaskGroup.h"
+
+enum class PipelineStageMode
+{
+	SerialInOrder,		// One token at a time, in the order the source produced them
+	SerialOutOfOrder,	// One token at a time, in any order
+	Parallel			// Any number of tokens at a time
+};
+
+// busy_time / elapsed is the stage's utilisation; the stage with the highest busy_time per token
+// is the bottleneck. max_buffered_tokens is the longest backlog seen in front of a serial stage.
+struct PipelineStageMetrics
+{
+	std::size_t number_of_tokens{};
+	std::chrono::steady_clock::duration busy_time{};
+	std::size_t max_buffered_tokens{};
+};
+
+struct PipelineMetrics
+{
+	std::chrono::steady_clock::duration elapsed{};
+	std::vector<PipelineStageMetrics> stages;
+};
+
+// Runs every token produced by a source through a chain of stages on an AsyncJobQueue<>, like TBB's
+// parallel_pipeline. Stages share the Token type, which carries the state from one stage to the next.
+// At most max_tokens_in_flight tokens exist at a time, which bounds the buffers in front of the serial
+// stages; the source is only called again once a token has left the last stage.
+template <typename Token>
+class Pipeline final
+{
+public:
+	explicit Pipeline(AsyncJobQueue<>& job_queue)
+		: job_queue{ job_queue }
+	{
+	}
+
+	template <typename Func>
+	requires std::invocable<Func&, Token&>
+	Pipeline& AddStage(PipelineStageMode mode, Func&& func)
+	{
+		stages.push_back(std::make_unique<Stage>(mode, std::forward<Func>(func)));
+
+		return *this;
+	}
+
+	// Calls source serially until it returns an empty optional and returns once every token has passed
+	// all stages. The calling thread runs pipeline jobs while waiting.
+	template <typename Source>
+	requires std::is_same_v<std::invoke_result_t<Source&>, std::optional<Token>>
+	PipelineMetrics Run(Source&& source, std::size_t max_tokens_in_flight = 0)
+	{
+		for (auto& stage : stages)
+		{
+			stage->next_sequence = 0;
+			stage->number_of_tokens = 0;
+			stage->busy_ticks = 0;
+			stage->max_buffered_tokens = 0;
+		}
+
+		this->source = std::ref(source);
+		this->max_tokens_in_flight = max_tokens_in_flight != 0 ? max_tokens_in_flight : (job_queue.GetNumberOfThreads() + 1) * 4;
+		number_of_tokens_in_flight = 0;
+		next_sequence = 0;
+		exhausted = false;
+		feeding = true;
+
+		auto const start{ std::chrono::steady_clock::now() };
+
+		{
+			TaskGroup task_group{ job_queue };
+
+			this->task_group = &task_group;
+
+			Feed();
+		}
+
+		PipelineMetrics metrics{ std::chrono::steady_clock::now() - start, {} };
+
+		for (auto& stage : stages)
+		{
+			metrics.stages.push_back({ stage->number_of_tokens, std::chrono::steady_clock::duration{ stage->busy_ticks.load() }, stage->max_buffered_tokens });
+		}
+
+		return metrics;
+	}
+
+private:
+	struct Item
+	{
+		std::size_t sequence;
+		Token token;
+	};
+
+	struct Stage
+	{
+		template <typename Func>
+		Stage(PipelineStageMode mode, Func&& func)
+			: mode{ mode }
+			, func{ std::forward<Func>(func) }
+		{
+		}
+
+		PipelineStageMode const mode;
+		std::function<void(Token&)> const func;
+		// Serial stages only: tokens waiting for the stage, by sequence number
+		std::mutex mutex;
+		std::map<std::size_t, std::unique_ptr<Item>> buffer;
+		std::size_t next_sequence{};
+		bool busy{};
+		std::size_t max_buffered_tokens{};
+		std::atomic_size_t number_of_tokens{};
+		std::atomic<std::chrono::steady_clock::rep> busy_ticks{};
+	};
+
+	AsyncJobQueue<>& job_queue;
+	std::vector<std::unique_ptr<Stage>> stages;
+	TaskGroup* task_group{};
+	std::function<std::optional<Token>()> source;
+	std::mutex mutex;
+	std::size_t max_tokens_in_flight{};
+	std::size_t number_of_tokens_in_flight{};
+	std::size_t next_sequence{};
+	bool exhausted{};
+	bool feeding{};
+
+	// Only one thread feeds at a time; it stops when the source is exhausted or the pipeline is full.
+	void Feed()
+	{
+		while (true)
+		{
+			std::unique_lock lk{ mutex };
+
+			if (exhausted || number_of_tokens_in_flight == max_tokens_in_flight)
+			{
+				feeding = false;
+
+				return;
+			}
+
+			++number_of_tokens_in_flight;
+
+			lk.unlock();
+
+			if (auto token{ source() })
+			{
+				task_group->Spawn([this](std::unique_ptr<Item> item) {
+					Process(0, std::move(item));
+				}, std::make_unique<Item>(next_sequence++, std::move(*token)));
+			}
+			else
+			{
+				lk.lock();
+
+				exhausted = true;
+				--number_of_tokens_in_flight;
+			}
+		}
+	}
+
+	// A token keeps running on the same thread through consecutive parallel stages. Serial stages buffer it
+	// and it is drained by whichever thread holds the stage.
+	void Process(std::size_t stage_index, std::unique_ptr<Item> item)
+	{
+		for (; stage_index != std::size(stages); ++stage_index)
+		{
+			auto& stage{ *stages[stage_index] };
+
+			if (stage.mode != PipelineStageMode::Parallel)
+			{
+				std::unique_lock lk{ stage.mutex };
+
+				stage.buffer.emplace(item->sequence, std::move(item));
+				stage.max_buffered_tokens = std::max(stage.max_buffered_tokens, std::size(stage.buffer));
+
+				if (!std::exchange(stage.busy, true))
+				{
+					lk.unlock();
+
+					Drain(stage_index);
+				}
+
+				return;
+			}
+
+			RunStage(stage, item->token);
+		}
+
+		Retire();
+	}
+
+	void Drain(std::size_t stage_index)
+	{
+		auto& stage{ *stages[stage_index] };
+
+		while (true)
+		{
+			std::unique_lock lk{ stage.mutex };
+
+			auto const it{ std::begin(stage.buffer) };
+
+			if (it == std::end(stage.buffer)
+				|| (stage.mode == PipelineStageMode::SerialInOrder && it->first != stage.next_sequence))
+			{
+				stage.busy = false;
+
+				return;
+			}
+
+			auto item{ std::move(it->second) };
+
+			stage.buffer.erase(it);
+			++stage.next_sequence;
+
+			lk.unlock();
+
+			RunStage(stage, item->token);
+
+			// Continuing inline would keep this serial stage blocked behind the rest of the chain.
+			task_group->Spawn([this, stage_index](std::unique_ptr<Item> item) {
+				Process(stage_index + 1, std::move(item));
+			}, std::move(item));
+		}
+	}
+
+	void RunStage(Stage& stage, Token& token)
+	{
+		auto const start{ std::chrono::steady_clock::now() };
+
+		stage.func(token);
+
+		stage.busy_ticks += (std::chrono::steady_clock::now() - start).count();
+		++stage.number_of_tokens;
+	}
+
+	void Retire()
+	{
+		std::unique_lock lk{ mutex };
+
+		--number_of_tokens_in_flight;
+
+		if (!exhausted && !std::exchange(feeding, true))
+		{
+			lk.unlock();
+
+			Feed();
+		}
+	}
+};
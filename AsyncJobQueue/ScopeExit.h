@@ -0,0 +1,26 @@
+#pragma once
+
+#include <utility>
+
+// Runs func when the guard goes out of scope, also while an exception propagates, so that state a job
+// run on the calling thread changes around it is restored even if the job throws.
+template <typename Func>
+class ScopeExit final
+{
+public:
+	explicit ScopeExit(Func func)
+		: func{ std::move(func) }
+	{
+	}
+
+	~ScopeExit()
+	{
+		func();
+	}
+
+	ScopeExit(ScopeExit const&) = delete;
+	ScopeExit& operator=(ScopeExit const&) = delete;
+
+private:
+	Func func;
+};
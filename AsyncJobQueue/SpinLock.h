@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Tells the core that the thread is busy-waiting, so it can yield resources to a sibling hyperthread.
+inline void SpinWaitPause()
+{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	_mm_pause();
+#else
+	std::this_thread::yield();
+#endif
+}
+
+// Lockable that never sleeps, for critical sections too short for the holder to be preempted
+// in the middle of one. Waiters spin on a plain load so that they do not bounce the cache line.
+class SpinLock final
+{
+public:
+	void lock() noexcept
+	{
+		while (locked.exchange(true, std::memory_order_acquire))
+		{
+			while (locked.load(std::memory_order_relaxed))
+			{
+				SpinWaitPause();
+			}
+		}
+	}
+
+	bool try_lock() noexcept
+	{
+		return !locked.load(std::memory_order_relaxed) && !locked.exchange(true, std::memory_order_acquire);
+	}
+
+	void unlock() noexcept
+	{
+		locked.store(false, std::memory_order_release);
+	}
+
+private:
+	std::atomic_bool locked{};
+};
+
+// Lockable that spins briefly and then sleeps on std::atomic::wait (a futex on Linux, WaitOnAddress
+// on Windows). Unlocking only makes a system call when some thread is asleep.
+class HybridMutex final
+{
+public:
+	void lock() noexcept
+	{
+		for (int i{}; i < spin_count; ++i)
+		{
+			if (state.load(std::memory_order_relaxed) == unlocked && try_lock())
+			{
+				return;
+			}
+
+			SpinWaitPause();
+		}
+
+		// Marking the mutex contended before sleeping makes the unlocking thread wake one waiter.
+		while (state.exchange(contended, std::memory_order_acquire) != unlocked)
+		{
+			state.wait(contended, std::memory_order_relaxed);
+		}
+	}
+
+	bool try_lock() noexcept
+	{
+		auto expected{ unlocked };
+
+		return state.compare_exchange_strong(expected, locked, std::memory_order_acquire, std::memory_order_relaxed);
+	}
+
+	void unlock() noexcept
+	{
+		if (state.exchange(unlocked, std::memory_order_release) == contended)
+		{
+			state.notify_one();
+		}
+	}
+
+private:
+	static constexpr int spin_count{ 100 };
+	static constexpr std::uint32_t unlocked{ 0 };
+	static constexpr std::uint32_t locked{ 1 };
+	static constexpr std::uint32_t contended{ 2 };
+
+	std::atomic<std::uint32_t> state{ unlocked };
+};
@@ -0,0 +1,16 @@
+#include "TaskGroup.h"
+
+TaskGroup::TaskGroup(AsyncJobQueue<>& job_queue)
+	: job_queue{ job_queue }
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+	Sync();
+}
+
+void TaskGroup::Sync()
+{
+	job_queue.Sync(this, number_of_pending_jobs);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "AsyncJobQueue.h"
+
+// Fork-join scope for recursive work on an AsyncJobQueue<>. A worker runs the jobs it spawns newest first
+// from its own deque, which keeps recursion depth-first and cache-local, while idle workers steal the
+// oldest (largest) jobs. Sync runs the group's jobs while waiting instead of blocking the worker.
+// Once max_queued_jobs jobs of a group are waiting, Spawn runs further jobs inline, which bounds memory.
+class TaskGroup final
+{
+public:
+	explicit TaskGroup(AsyncJobQueue<>& job_queue);
+	~TaskGroup();
+
+	TaskGroup(TaskGroup const&) = delete;
+	TaskGroup& operator=(TaskGroup const&) = delete;
+
+	template <typename Func, typename... Ts>
+	requires std::is_same_v<std::invoke_result_t<Func, Ts...>, void>
+	void Spawn(Func&& func, Ts&&... ts)
+	{
+		if (number_of_queued_jobs >= max_queued_jobs)
+		{
+			std::invoke(std::forward<Func>(func), std::forward<Ts>(ts)...);
+
+			return;
+		}
+
+		++number_of_queued_jobs;
+		++number_of_pending_jobs;
+
+		// The group may be destroyed as soon as number_of_pending_jobs drops to zero.
+		auto job{ [this] <typename... Xs>(Xs&&... xs) {
+			--number_of_queued_jobs;
+
+			ScopeExit const finish{ [this] {
+				--number_of_pending_jobs;
+			} };
+
+			std::invoke(std::forward<Xs>(xs)...);
+		} };
+
+		job_queue.Spawn(std::async(std::launch::deferred, job, std::forward<Func>(func), std::forward<Ts>(ts)...), this);
+	}
+
+	// Returns once every job spawned into this group has finished.
+	void Sync();
+
+private:
+	static constexpr std::size_t max_queued_jobs{ 256 };
+
+	AsyncJobQueue<>& job_queue;
+	std::atomic_size_t number_of_queued_jobs{};
+	std::atomic_size_t number_of_pending_jobs{};
+};
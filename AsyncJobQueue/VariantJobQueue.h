@@ -0,0 +1,256 @@
+#pragma once
+
+#include "ScopeExit.h"
+
+#include <algorithm>
+#include <concepts>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <variant>
+#include <vector>
+
+// Job queue for a closed set of job types. Jobs are stored by value in a ring buffer of
+// std::variant<Jobs...> allocated with the queue and run through std::visit, so adding a job
+// neither allocates nor type-erases it, and each job type's call can be inlined into the worker.
+// Add blocks while capacity jobs are pending.
+template <typename... Jobs>
+	requires (sizeof...(Jobs) != 0 && (std::invocable<Jobs> && ...))
+class VariantJobQueue final
+{
+public:
+	using Job = std::variant<Jobs...>;
+
+	explicit VariantJobQueue(std::size_t number_of_threads = std::thread::hardware_concurrency() * 2, std::size_t capacity = 1024)
+		: ring(std::max<std::size_t>(capacity, 1))
+		, thread_pool{ number_of_threads }
+	{
+		std::ranges::generate(thread_pool, [this] {
+			return std::jthread{ std::bind_front(&VariantJobQueue::JobDispatcherThread, this) };
+		});
+	}
+
+	// Pending jobs still run before the workers exit.
+	~VariantJobQueue()
+	{
+		for (auto& t : thread_pool)
+		{
+			t.request_stop();
+		}
+
+		job_condition_variable.notify_all();
+	}
+
+	// A job of this queue that finds the queue full runs the oldest pending job itself instead of
+	// blocking, so a full queue cannot deadlock the pool.
+	template <typename T>
+		requires std::constructible_from<Job, T>
+	void Add(T&& job)
+	{
+		std::unique_lock lk{ mutex_for_condition_variable };
+
+		WaitForCapacity(lk);
+		Push(lk, [&job](std::optional<Job>& slot) {
+			slot.emplace(std::forward<T>(job));
+		});
+	}
+
+	// Constructs a job of type T in place.
+	template <typename T, typename... Ts>
+		requires (std::same_as<T, Jobs> || ...) && std::constructible_from<T, Ts...>
+	void Emplace(Ts&&... ts)
+	{
+		std::unique_lock lk{ mutex_for_condition_variable };
+
+		WaitForCapacity(lk);
+		Push(lk, [&ts...](std::optional<Job>& slot) {
+			slot.emplace(std::in_place_type<T>, std::forward<Ts>(ts)...);
+		});
+	}
+
+	// Returns false instead of blocking when the queue is full.
+	template <typename T>
+		requires std::constructible_from<Job, T>
+	bool TryAdd(T&& job)
+	{
+		std::unique_lock lk{ mutex_for_condition_variable };
+
+		if (number_of_pending_jobs == std::size(ring))
+		{
+			return false;
+		}
+
+		Push(lk, [&job](std::optional<Job>& slot) {
+			slot.emplace(std::forward<T>(job));
+		});
+
+		return true;
+	}
+
+	// Runs pending jobs on the calling thread while waiting; jobs running on the calling thread itself
+	// (i.e. the caller is a job) are not waited for, but every other job is, even one blocked in a Join
+	// of its own, so two jobs that Join at the same time deadlock.
+	void Join()
+	{
+		std::unique_lock lk{ mutex_for_condition_variable };
+
+		++number_of_joining_threads;
+
+		ScopeExit const leave{ [this] {
+			--number_of_joining_threads;
+		} };
+
+		while (number_of_pending_jobs != 0 || number_of_running_jobs != CountRunningJobFrames())
+		{
+			if (number_of_pending_jobs != 0)
+			{
+				RunJob(lk);
+			}
+			else
+			{
+				join_condition_variable.wait(lk);
+			}
+		}
+	}
+
+	std::size_t GetNumberOfThreads() const
+	{
+		return std::size(thread_pool);
+	}
+
+private:
+	struct RunningJobFrame
+	{
+		VariantJobQueue const* queue;
+		RunningJobFrame const* parent;
+	};
+
+	static inline thread_local RunningJobFrame const* running_job_frame{};
+
+	std::mutex mutex_for_condition_variable;
+	std::condition_variable job_condition_variable;
+	std::condition_variable join_condition_variable;
+	std::condition_variable add_condition_variable;
+	// Pending jobs are the number_of_pending_jobs slots from head on, wrapping around.
+	std::vector<std::optional<Job>> ring;
+	std::size_t head{};
+	std::size_t number_of_pending_jobs{};
+	std::size_t number_of_running_jobs{};
+	std::size_t number_of_joining_threads{};
+	std::size_t number_of_waiting_producers{};
+	std::vector<std::jthread> thread_pool;
+
+	std::size_t CountRunningJobFrames() const
+	{
+		std::size_t count{};
+
+		for (auto frame{ running_job_frame }; frame != nullptr; frame = frame->parent)
+		{
+			if (frame->queue == this)
+			{
+				++count;
+			}
+		}
+
+		return count;
+	}
+
+	void WaitForCapacity(std::unique_lock<std::mutex>& lk)
+	{
+		while (number_of_pending_jobs == std::size(ring))
+		{
+			if (CountRunningJobFrames() != 0)
+			{
+				RunJob(lk);
+
+				continue;
+			}
+
+			++number_of_waiting_producers;
+			add_condition_variable.wait(lk);
+			--number_of_waiting_producers;
+		}
+	}
+
+	template <typename Construct>
+	void Push(std::unique_lock<std::mutex>& lk, Construct construct)
+	{
+		construct(ring[(head + number_of_pending_jobs) % std::size(ring)]);
+		++number_of_pending_jobs;
+
+		auto const notify_joining_threads{ number_of_joining_threads != 0 };
+
+		lk.unlock();
+
+		job_condition_variable.notify_one();
+
+		if (notify_joining_threads)
+		{
+			join_condition_variable.notify_all();
+		}
+	}
+
+	// Must be called with lk held and a job pending; lk is released while the job runs and held again on return.
+	void RunJob(std::unique_lock<std::mutex>& lk)
+	{
+		auto job{ std::move(*ring[head]) };
+
+		ring[head].reset();
+		head = (head + 1) % std::size(ring);
+		--number_of_pending_jobs;
+		++number_of_running_jobs;
+
+		if (number_of_waiting_producers != 0)
+		{
+			add_condition_variable.notify_one();
+		}
+
+		RunningJobFrame const frame{ this, running_job_frame };
+
+		running_job_frame = &frame;
+
+		lk.unlock();
+
+		// If the job throws, the exception propagates to the caller with lk held again.
+		ScopeExit const finish{ [this, &lk, &frame] {
+			lk.lock();
+
+			running_job_frame = frame.parent;
+
+			--number_of_running_jobs;
+
+			if (number_of_joining_threads != 0)
+			{
+				join_condition_variable.notify_all();
+			}
+		} };
+
+		std::visit([](auto& job) {
+			std::invoke(std::move(job));
+		}, job);
+	}
+
+	void JobDispatcherThread(std::stop_token stop_token)
+	{
+		std::unique_lock lk{ mutex_for_condition_variable };
+
+		while (true)
+		{
+			if (number_of_pending_jobs != 0)
+			{
+				RunJob(lk);
+			}
+			else if (stop_token.stop_requested())
+			{
+				break;
+			}
+			else
+			{
+				job_condition_variable.wait(lk, [this, &stop_token] { return stop_token.stop_requested() || number_of_pending_jobs != 0; });
+			}
+		}
+	}
+};
@@ -1,14 +1,32 @@
 #include "AsyncJobQueue.h"
+#include "Actors.h"
+#include "ParallelAlgorithm.h"
+#include "Benchmark.h"
 
 #include <iostream>
 #include <format>
 #include <ranges>
 #include <atomic>
+#include <string_view>
+#include <latch>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <memory>
+#include <chrono>
 
 using namespace std::literals;
 
-int main()
+int main(int argc, char* argv[])
 {
+    if (argc > 1 && argv[1] == "--benchmark"sv)
+    {
+        RunBenchmarks();
+
+        return 0;
+    }
+
     {
         AsyncJobQueue job_queue;
 
@@ -62,5 +80,133 @@ int main()
         std::cout << std::format("Actual 2: {}\n", actual2.load());
     }
 
+    {
+        // std::string keys are looked up by std::string_view, which only becomes a std::string when interned.
+        AsyncJobQueue<std::string> job_queue;
+        std::atomic_int count;
+        constexpr std::string_view key{ "view" };
+
+        for (int i{}; i < 10; ++i)
+        {
+            job_queue.Add(key, [&count] { ++count; });
+        }
+
+        job_queue.Join(key);
+        job_queue.Cancel(key);
+
+        std::cout << std::format("Jobs by std::string_view key: {}\n", count.load());
+    }
+
+    {
+        // Two jobs joining at once, each for the children it added, do not wait for each other.
+        AsyncJobQueue<std::string> job_queue{ 4 };
+        std::atomic_int children;
+        std::latch parents_started{ 2 };
+
+        for (int i{}; i < 2; ++i)
+        {
+            job_queue.Add(std::format("parent{}", i), [&job_queue, &children, &parents_started, i] {
+                auto const child_key{ std::format("child{}", i) };
+
+                parents_started.arrive_and_wait();
+
+                for (int j{}; j < 20; ++j)
+                {
+                    job_queue.Add(child_key, [&children] { ++children; });
+                }
+
+                job_queue.Join(child_key);
+            });
+        }
+
+        job_queue.Join();
+
+        std::cout << std::format("Nested joins: {}\n", children.load());
+    }
+
+    {
+        // Joining a key waits for its running job even while that job is in a Join of its own.
+        AsyncJobQueue<std::string> job_queue{ 4 };
+        std::atomic_bool child_done;
+        std::atomic_bool waited_for_child;
+        std::latch child_started{ 1 };
+
+        job_queue.Add("child", [&job_queue, &child_done, &child_started] {
+            job_queue.Add("grandchild", [] { std::this_thread::sleep_for(100ms); });
+            child_started.count_down();
+            job_queue.Join("grandchild");
+            child_done = true;
+        });
+        job_queue.Add("parent", [&job_queue, &child_done, &waited_for_child, &child_started] {
+            child_started.wait();
+            job_queue.Join("child");
+            waited_for_child = child_done.load();
+        });
+
+        job_queue.Join();
+
+        std::cout << std::format("Join waited for nested join: {}\n", waited_for_child.load());
+    }
+
+    {
+        // Merging moves strings out of their runs, so this checks that no part saw a moved-from one.
+        AsyncJobQueue job_queue{ 4 };
+        std::vector<std::string> words;
+
+        for (int i{}; i < 100'000; ++i)
+        {
+            words.push_back(std::format("word{}", i * 7919 % 100'000));
+        }
+
+        Sort(job_queue, words);
+
+        std::cout << std::format("Sorted strings: {}\n", std::ranges::is_sorted(words) && std::ranges::adjacent_find(words) == std::end(words));
+    }
+
+    {
+        // A message that throws does not keep its actor from draining the rest of its mailbox. Without
+        // workers, the Join runs the drain job and so receives the exception.
+        AsyncJobQueue<std::string> job_queue{ 0 };
+        Actors<std::string, int> counters{ job_queue };
+
+        counters.Tell("counter", [](int& count) { ++count; });
+        counters.Tell("counter", [](int&) { throw std::runtime_error{ "message failed" }; });
+        counters.Tell("counter", [](int& count) { ++count; });
+
+        try
+        {
+            job_queue.Join("counter");
+        }
+        catch (std::runtime_error const& e)
+        {
+            std::cout << std::format("Actor message threw: {}\n", e.what());
+        }
+
+        int count{};
+
+        counters.Tell("counter", [&count](int& state) { count = state; });
+        job_queue.Join("counter");
+
+        std::cout << std::format("Actor count after a throwing message: {}\n", count);
+    }
+
+    {
+        // An expired job is destroyed outside the lock, so state it captured may call back into the queue.
+        AsyncJobQueue<> job_queue{ 0 };
+        std::size_t number_of_expired_jobs{};
+
+        {
+            std::shared_ptr<void> const state{ nullptr, [&job_queue, &number_of_expired_jobs](void*) {
+                number_of_expired_jobs = job_queue.GetMetrics().number_of_expired_jobs;
+            } };
+
+            job_queue.AddWithExpiry(std::chrono::steady_clock::now() - std::chrono::seconds{ 1 }, [state] {});
+        }
+
+        job_queue.Join();
+
+        std::cout << std::format("Expired jobs seen from a destructor: {}\n", number_of_expired_jobs);
+    }
+
     std::cout << "main() end\n";
 }